@@ -7,6 +7,11 @@
 #include "cli.h"
 #include "cmd_run.h"
 #include "cmd_create.h"
+#include "cmd_registry.h"
+#include "log_buffer.h"
+#include "session.h"
+#include "cli_stats.h"
+#include "cmd_coop.h"
 
 
 
@@ -38,6 +43,30 @@
 
 #define CLI_AUTOCOMPLETE_ENABLED CONFIG_CLI_AUTOCOMPLETE_ENABLED
 
+#if defined(CONFIG_CLI_LOG_BUFFER_ENABLED)
+#define CLI_LOG_BUFFER_ENABLED 1
+#else
+#define CLI_LOG_BUFFER_ENABLED 0
+#endif
+
+#if defined(CONFIG_CLI_SESSION_ENABLED)
+#define CLI_SESSION_ENABLED 1
+#else
+#define CLI_SESSION_ENABLED 0
+#endif
+
+#if defined(CONFIG_CLI_COOP_ENABLED)
+#define CLI_COOP_ENABLED 1
+#else
+#define CLI_COOP_ENABLED 0
+#endif
+
+#if defined(CONFIG_CLI_STATIC_ALLOCATION)
+#define CLI_STATIC_ALLOCATION 1
+#else
+#define CLI_STATIC_ALLOCATION 0
+#endif
+
 
 static char data_buff[CLI_HISTORY_LEN*CLI_MAX_LENGTH];
 struct cli_status_s {
@@ -48,22 +77,41 @@ struct cli_status_s {
     int current_hist;
     bool insert;
     char* data[CLI_HISTORY_LEN];
+    bool paste;
+#if CLI_ANSI_ESCAPE_CODE_ENABLED==1
+    struct {
+        uint8_t state;
+        char intro;
+        char params[8];
+        uint8_t params_len;
+    } esc;
+    int paste_len;
+    char paste_buff[CLI_MAX_LENGTH];
+#endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
     vprintf_like_t log_print_func;
     flush_fc_t log_flush_func;
     vprintf_like_t cli_print_func;
     flush_fc_t cli_flush_func;
     TaskHandle_t task_handle;
+    cli_capture_t* captures;
     bool running_sync_command;
+    int typeahead_pos;
+    int typeahead_len;
+    uint8_t typeahead[CLI_MAX_LENGTH];
 };
 static struct cli_status_s cli_status;
+static portMUX_TYPE cli_capture_mux = portMUX_INITIALIZER_UNLOCKED;
 
-
-extern cli_funct_info_t __cli_commands_start[], __cli_commands_end[];
+#if CLI_STATIC_ALLOCATION==1
+static StaticTask_t cli_task_buff;
+static StackType_t cli_task_stack[CLI_TASK_STACK];
+#endif //CLI_STATIC_ALLOCATION==1
 
 
 int log_vprintf(const char* format, va_list args);
 
 int cli_output(const char* format, ...);
+int cli_print(const char* format, va_list args);
 
 void draw_cli(void);
 void clear_cli(void);
@@ -71,6 +119,9 @@ void redraw_cli(void);
 
 void cli_task(void);
 
+cli_capture_t* cli_capture_current(void);
+int cli_capture_vprintf(cli_capture_t* capture, const char* format, va_list args);
+
 
 int flush_default(void) {
     return fflush(NULL);
@@ -110,9 +161,16 @@ void esp_cli_init(cli_init_t init) {
 
     cli_status.running_sync_command = false;
 
+#if CLI_ANSI_ESCAPE_CODE_ENABLED==1
+    cli_output("\033[?2004h");  // enable bracketed paste mode
+#endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
     draw_cli();
 
+#if CLI_STATIC_ALLOCATION==1
+    cli_status.task_handle = xTaskCreateStatic((TaskFunction_t)cli_task, CLI_TASK_NAME, CLI_TASK_STACK, NULL, CLI_TASK_PRI, cli_task_stack, &cli_task_buff);
+#else
     xTaskCreate((TaskFunction_t)cli_task, CLI_TASK_NAME, CLI_TASK_STACK, NULL, CLI_TASK_PRI, &(cli_status.task_handle));
+#endif //CLI_STATIC_ALLOCATION==1
 
     cli_status.inited = true;
 }
@@ -120,6 +178,16 @@ void esp_cli_init(cli_init_t init) {
 
 /* Logging redirection */
 int log_vprintf(const char* format, va_list args) {
+    CLI_STATS_ADD(log_lines, 1);
+#if CLI_LOG_BUFFER_ENABLED==1
+    va_list record_args;
+    va_copy(record_args, args);
+    log_buffer_record(format, record_args);
+    va_end(record_args);
+    if ( !log_buffer_console_enabled() ) {
+        return 0;
+    }
+#endif //CLI_LOG_BUFFER_ENABLED==1
     // Clear and draw CLI only if the logging is output on the same interface
     if ( cli_status.log_print_func == cli_status.cli_print_func  &&  !cli_status.running_sync_command ) {
         clear_cli();
@@ -137,6 +205,57 @@ int log_vprintf(const char* format, va_list args) {
     return ret;
 }
 
+/* Output capture: cli_printf() calls from a task can be redirected to a buffer */
+void cli_capture_begin(cli_capture_t* capture, char* buff, size_t size) {
+    capture->task = xTaskGetCurrentTaskHandle();
+    capture->buff = buff;
+    capture->size = size;
+    capture->len = 0;
+    if ( size > 0 ) {
+        buff[0] = '\0';
+    }
+    portENTER_CRITICAL(&cli_capture_mux);
+    capture->next = cli_status.captures;
+    cli_status.captures = capture;
+    portEXIT_CRITICAL(&cli_capture_mux);
+}
+
+size_t cli_capture_end(cli_capture_t* capture) {
+    portENTER_CRITICAL(&cli_capture_mux);
+    for (cli_capture_t** it=&cli_status.captures ; *it!=NULL ; it=&(*it)->next) {
+        if ( *it == capture ) {
+            *it = capture->next;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&cli_capture_mux);
+    return capture->len;
+}
+
+cli_capture_t* cli_capture_current(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    cli_capture_t* capture;
+    portENTER_CRITICAL(&cli_capture_mux);
+    for (capture=cli_status.captures ; capture!=NULL ; capture=capture->next) {
+        if ( capture->task == task ) {
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&cli_capture_mux);
+    return capture;
+}
+
+int cli_capture_vprintf(cli_capture_t* capture, const char* format, va_list args) {
+    if ( capture->len+1 >= capture->size ) {
+        return 0;
+    }
+    int ret = vsnprintf(capture->buff+capture->len, capture->size-capture->len, format, args);
+    if ( ret > 0 ) {
+        capture->len += ret < capture->size-capture->len ? ret : capture->size-capture->len-1;
+    }
+    return ret;
+}
+
 /* CLI printing */
 int cli_printf(const char* format, ...) {
     va_list list;
@@ -146,10 +265,16 @@ int cli_printf(const char* format, ...) {
     return ret;
 }
 int cli_vprintf(const char* format, va_list args) {
+    if ( cli_status.captures != NULL ) {
+        cli_capture_t* capture = cli_capture_current();
+        if ( capture != NULL ) {
+            return cli_capture_vprintf(capture, format, args);
+        }
+    }
     if ( !cli_status.running_sync_command ) {
         clear_cli();
     }
-    int ret = cli_status.cli_print_func(format, args);
+    int ret = cli_print(format, args);
     if ( !cli_status.running_sync_command ) {
         draw_cli();
     }
@@ -158,10 +283,26 @@ int cli_vprintf(const char* format, va_list args) {
 int cli_output(const char* format, ...) {
     va_list list;
     va_start(list, format);
-    int ret = cli_status.cli_print_func(format, list);
+    int ret = cli_print(format, list);
     va_end(list);
     return ret;
 }
+int cli_print(const char* format, va_list args) {
+    int ret;
+#if CLI_SESSION_ENABLED==1
+    if ( session_active() ) {
+        ret = session_print(cli_status.cli_print_func, format, args);
+    }
+    else
+#endif //CLI_SESSION_ENABLED==1
+    {
+        ret = cli_status.cli_print_func(format, args);
+    }
+    if ( ret > 0 ) {
+        CLI_STATS_ADD(output_bytes, ret);
+    }
+    return ret;
+}
 void draw_cli(void) {
     cli_output("%c %.*s", cli_status.delimiter, cli_status.current_length, cli_status.data[cli_status.current_hist]);
 #if CLI_ANSI_ESCAPE_CODE_ENABLED==1
@@ -193,57 +334,110 @@ void clear_cli(void) {
 #endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
 }
 void redraw_cli(void) {
+    CLI_STATS_ADD(redraws, 1);
     clear_cli();
     draw_cli();
 }
 
 
 /* CLI manipulation */
-void cli_add_char_at(int pos, uint8_t val, bool overwrite) {
-    if (cli_status.current_length < CLI_MAX_LENGTH-1  &&  pos <= cli_status.current_length) {
-        clear_cli();
+void cli_edit_current(void) {
 #if CLI_HISTORY_ENABLED==1
-        if (cli_status.current_hist > 0) {
-            memcpy(cli_status.data[0], cli_status.data[cli_status.current_hist], CLI_MAX_LENGTH);
-            cli_status.current_hist = 0;
-        }
+    if (cli_status.current_hist > 0) {
+        memcpy(cli_status.data[0], cli_status.data[cli_status.current_hist], CLI_MAX_LENGTH);
+        cli_status.current_hist = 0;
+    }
 #endif //CLI_HISTORY_ENABLED==1
-        if (pos == cli_status.current_length) {
-            overwrite = false;
-        }
-        if (!overwrite) {
-            for (int i=cli_status.current_length ; i>=0 && i>pos ; i--) {
-                cli_status.data[cli_status.current_hist][i] = cli_status.data[cli_status.current_hist][i-1];
-            }
-        }
-        cli_status.data[cli_status.current_hist][pos] = val;
-        cli_status.current_pos++;
-        if (!overwrite) {
-            cli_status.current_length++;
-        }
-        draw_cli();
+}
+
+void cli_insert_str_at(int pos, const char* str, int len, bool overwrite) {
+    if (len <= 0  ||  pos < 0  ||  pos > cli_status.current_length) {
+        return;
+    }
+    int replaced = 0;
+    if (overwrite) {
+        replaced = cli_status.current_length-pos < len ? cli_status.current_length-pos : len;
     }
+    int added = len - replaced;
+    if (added > CLI_MAX_LENGTH-1 - cli_status.current_length) {
+        added = CLI_MAX_LENGTH-1 - cli_status.current_length;
+        len = replaced + added;
+    }
+    if (len == 0) {
+        return;
+    }
+
+    clear_cli();
+    cli_edit_current();
+    char* line = cli_status.data[cli_status.current_hist];
+    memmove(line+pos+len, line+pos+replaced, cli_status.current_length-pos-replaced);
+    memcpy(line+pos, str, len);
+    cli_status.current_length += added;
+    line[cli_status.current_length] = '\0';
+    cli_status.current_pos = pos+len;
+    draw_cli();
 }
 
-void cli_remove_char_at(int pos, bool move_back) {
-    if (cli_status.current_length > 0  &&  ((move_back && cli_status.current_pos>0) || (!move_back && cli_status.current_pos>=0))  &&  pos < cli_status.current_length) {
-        clear_cli();
-#if CLI_HISTORY_ENABLED==1
-        if (cli_status.current_hist > 0) {
-            memcpy(cli_status.data[0], cli_status.data[cli_status.current_hist], CLI_MAX_LENGTH);
-            cli_status.current_hist = 0;
-        }
-#endif //CLI_HISTORY_ENABLED==1
-        for (int i=pos ; i<cli_status.current_length-1 ; i++) {
-            cli_status.data[cli_status.current_hist][i] = cli_status.data[cli_status.current_hist][i+1];
-        }
-        cli_status.data[cli_status.current_hist][cli_status.current_length-1] = 0;
-        if (move_back) {
-            cli_status.current_pos--;
-        }
-        cli_status.current_length--;
-        draw_cli();
+void cli_add_char_at(int pos, uint8_t val, bool overwrite) {
+    cli_insert_str_at(pos, (const char*)&val, 1, overwrite);
+}
+
+void cli_remove_range(int start, int end) {
+    if (start < 0) {
+        start = 0;
+    }
+    if (end > cli_status.current_length) {
+        end = cli_status.current_length;
     }
+    if (start >= end) {
+        return;
+    }
+
+    clear_cli();
+    cli_edit_current();
+    char* line = cli_status.data[cli_status.current_hist];
+    memmove(line+start, line+end, cli_status.current_length-end);
+    cli_status.current_length -= end-start;
+    memset(line+cli_status.current_length, 0, end-start);
+    cli_status.current_pos = start;
+    draw_cli();
+}
+
+void cli_move_cursor(int pos) {
+    if (pos < 0) {
+        pos = 0;
+    }
+    if (pos > cli_status.current_length) {
+        pos = cli_status.current_length;
+    }
+    if (pos == cli_status.current_pos) {
+        return;
+    }
+    clear_cli();
+    cli_status.current_pos = pos;
+    draw_cli();
+}
+
+int cli_word_start(int pos) {
+    const char* line = cli_status.data[cli_status.current_hist];
+    while (pos > 0  &&  line[pos-1] == ' ') {
+        pos--;
+    }
+    while (pos > 0  &&  line[pos-1] != ' ') {
+        pos--;
+    }
+    return pos;
+}
+
+int cli_word_end(int pos) {
+    const char* line = cli_status.data[cli_status.current_hist];
+    while (pos < cli_status.current_length  &&  line[pos] == ' ') {
+        pos++;
+    }
+    while (pos < cli_status.current_length  &&  line[pos] != ' ') {
+        pos++;
+    }
+    return pos;
 }
 
 #if CLI_HISTORY_ENABLED==1
@@ -274,6 +468,47 @@ void down_history() {}
 #endif //CLI_HISTORY_ENABLED==1
 
 #if CLI_AUTOCOMPLETE_ENABLED==1
+struct autocomplete_s {
+    int tab_cnt;
+    int res_cnt;
+    char* complete;
+};
+// only used from the CLI task, and names longer than a command line cannot be completed anyway
+static char autocomplete_buff[CLI_MAX_LENGTH];
+
+bool autocomplete_match(const cli_funct_info_t* cmd_info, void* arg) {
+    struct autocomplete_s* ac = (struct autocomplete_s*)arg;
+    if ( strncmp(cli_status.data[cli_status.current_hist], cmd_info->name, cli_status.current_pos) == 0 ) {
+        if (ac->res_cnt == 0) {
+            if ( ac->tab_cnt > 1 ) {
+                cli_output("\n");
+            }
+            else {
+                ac->complete = autocomplete_buff;
+                strncpy(ac->complete, cmd_info->name, CLI_MAX_LENGTH-1);
+                ac->complete[CLI_MAX_LENGTH-1] = '\0';
+            }
+        }
+        else if ( ac->tab_cnt == 1  &&  ac->complete != NULL ) {
+            int len1 = strlen(ac->complete)+1;
+            int len2 = strlen(cmd_info->name)+1;
+            for (int i=0 ; i<len1 && i<len2 ; i++) {
+                if (ac->complete[i] != cmd_info->name[i]) {
+                    ac->complete[i] = '\0';
+                    break;
+                }
+            }
+        }
+
+        if ( ac->tab_cnt > 1 ) {
+            cli_printf("%s\n", cmd_info->name);
+        }
+
+        ac->res_cnt++;
+    }
+    return true;
+}
+
 int autocomplete (int tab_cnt) {
     if (strlen((char*)cli_status.data[cli_status.current_hist]) == 0) {
         return tab_cnt;
@@ -285,38 +520,10 @@ int autocomplete (int tab_cnt) {
             }
         }
 
-        cli_funct_info_t* cmd_info;
-        int res_cnt = 0;
-        char* complete = NULL;
-        for (cmd_info=__cli_commands_start ; cmd_info<__cli_commands_end ; cmd_info++) {
-            if ( strncmp(cli_status.data[cli_status.current_hist], cmd_info->name, cli_status.current_pos) == 0 ) {
-                if (res_cnt == 0) {
-                    if ( tab_cnt > 1 ) {
-                        cli_output("\n");
-                    }
-                    else {
-                        complete = malloc( strlen(cmd_info->name) + 1 );
-                        strcpy(complete, cmd_info->name);
-                    }
-                }
-                else if ( tab_cnt == 1 ) {
-                    int len1 = strlen(complete)+1;
-                    int len2 = strlen(cmd_info->name)+1;
-                    for (int i=0 ; i<len1 && i<len2 ; i++) {
-                        if (complete[i] != cmd_info->name[i]) {
-                            complete[i] = '\0';
-                            break;
-                        }
-                    }
-                }
-
-                if ( tab_cnt > 1 ) {
-                    cli_printf("%s\n", cmd_info->name);
-                }
-
-                res_cnt++;
-            }
-        }
+        struct autocomplete_s ac = { .tab_cnt = tab_cnt, .res_cnt = 0, .complete = NULL };
+        cli_registry_foreach(autocomplete_match, &ac);
+        int res_cnt = ac.res_cnt;
+        char* complete = ac.complete;
 
         redraw_cli();
 
@@ -325,18 +532,14 @@ int autocomplete (int tab_cnt) {
             if (cli_status.current_pos < len) {
                 tab_cnt = 0;
             }
-            for (int i=cli_status.current_pos ; i<len ; i++) {
-                cli_add_char_at(cli_status.current_pos, complete[i], false);
+            if (cli_status.current_pos < len) {
+                cli_insert_str_at(cli_status.current_pos, complete+cli_status.current_pos, len-cli_status.current_pos, false);
             }
             if (res_cnt == 1) {
                 cli_add_char_at(cli_status.current_pos, ' ', false);
             }
         }
 
-        if (complete != NULL) {
-            free(complete);
-        }
-
         return tab_cnt;
     }
 }
@@ -346,6 +549,77 @@ int autocomplete (int tab_cnt) { return tab_cnt; }
 
 
 /* CLI task utilities */
+
+/* Reads the console. Each byte is recorded where it is read, so the input read while a
+   command runs (Ctrl-C, the key interrupting it, its own input) is part of a recording.
+   While a session is replayed, that input comes from the recording. */
+static int read_input(bool polled) {
+#if CLI_SESSION_ENABLED==1
+    if (polled  &&  session_replaying()) {
+        return session_replay_polled_input();
+    }
+#endif //CLI_SESSION_ENABLED==1
+    int in = getchar();
+#if CLI_SESSION_ENABLED==1
+    if (in != EOF) {
+        session_record_input(in, polled);
+    }
+#endif //CLI_SESSION_ENABLED==1
+    return in;
+}
+
+/* Input read while a command ran, and not processed yet */
+int cli_typeahead_getchar(void) {
+    if (cli_status.typeahead_pos < cli_status.typeahead_len) {
+        return cli_status.typeahead[cli_status.typeahead_pos++];
+    }
+    cli_status.typeahead_pos = 0;
+    cli_status.typeahead_len = 0;
+    return EOF;
+}
+
+int cli_getchar(void) {
+    int in = cli_typeahead_getchar();
+    return in != EOF ? in : read_input(false);
+}
+
+/* Moves the bytes not processed yet to the start of the typeahead */
+static void typeahead_compact(void) {
+    int pending = cli_status.typeahead_len - cli_status.typeahead_pos;
+    memmove(cli_status.typeahead, cli_status.typeahead+cli_status.typeahead_pos, pending);
+    cli_status.typeahead_pos = 0;
+    cli_status.typeahead_len = pending;
+}
+
+/* Room left where the next input byte goes: the command when it reads the input */
+static int input_room(void) {
+    int room = cli_cmd_input_room();
+    return room >= 0 ? room : sizeof(cli_status.typeahead) - cli_status.typeahead_len;
+}
+
+/* Called while a command runs in the foreground: Ctrl-C (or any key if the command
+   asked for it) interrupts it. Anything else goes to the command if it reads its input
+   with CLI_CMD_GETCHAR(), as the console is only read from this task. Otherwise it is
+   kept in order in the typeahead, and is only decoded and echoed once the command
+   returns and the prompt is redrawn. When there is no room left the input is left in
+   the driver rather than dropped, so a pasted block is never cut or reordered. */
+bool poll_interrupt(bool any_key) {
+#if CLI_COOP_ENABLED==1
+    cli_coop_run_jobs(0);  // background jobs keep running while a command runs in the foreground
+#endif //CLI_COOP_ENABLED==1
+    typeahead_compact();
+    int in;
+    while (input_room() > 0  &&  (in = read_input(true)) != EOF) {
+        if (in == 0x03  ||  any_key) {
+            return true;
+        }
+        if (!cli_cmd_input(in)  &&  cli_status.typeahead_len < sizeof(cli_status.typeahead)) {
+            cli_status.typeahead[cli_status.typeahead_len++] = in;
+        }
+    }
+    return false;
+}
+
 void parse_cmd_line() {
     if (strlen((char*)cli_status.data[cli_status.current_hist]) == 0) {
         cli_output("\n");
@@ -367,10 +641,10 @@ void parse_cmd_line() {
         cli_status.current_length = strlen((char*)cli_status.data[cli_status.current_hist]);
         cli_status.current_pos = cli_status.current_length;
         int cmd_run_len = strlen(cli_status.data[1]);
-        bool async = false;
+        bool async = false;  // a trailing '&', not the end of a '&&'
         for (int i=cmd_run_len-1 ; i>0 ; i--) {
             if ( cli_status.data[1][i] == '&' ) {
-                async = true;
+                async = cli_status.data[1][i-1] != '&';
                 break;
             }
             else if ( cli_status.data[1][i] != ' ' ) {
@@ -383,7 +657,7 @@ void parse_cmd_line() {
         }
         else {
             cli_status.running_sync_command = true;
-            ret = CLI_RUN(cli_status.data[1]);
+            ret = cli_cmd_run_poll(false, cli_status.data[1], poll_interrupt);
         }
         if ( ret == CLI_CMD_RETURN_ASYNC_TIMEOUT  ||  ret == CLI_CMD_RETURN_RUNTIME_ERROR ) {
             cli_printf("Error running the command...\n");
@@ -391,154 +665,255 @@ void parse_cmd_line() {
         else if ( ret == CLI_CMD_RETURN_CMD_NOT_FOUND ) {
             cli_printf("Command not found\n");
         }
+        else if ( ret == CLI_CMD_RETURN_TIMEOUT ) {
+            cli_printf("Command timed out\n");
+        }
+        else if ( ret == CLI_CMD_RETURN_CANCELLED ) {
+            cli_printf("^C\n");
+        }
         cli_status.running_sync_command = false;
         redraw_cli();
     }
 }
 
-#if CLI_ANSI_ESCAPE_CODE_ENABLED==1
-#define SPECIAL_CMD_MAX_LEN 3
-int process_special_command(uint8_t val) {
-    static int special_cmd = 0;
-    static uint8_t special_cmd_str[SPECIAL_CMD_MAX_LEN] = {0};
-    static uint8_t special_cmd_ptr = 0;
-
-    special_cmd_str[special_cmd_ptr] = val;
-    switch (special_cmd_str[special_cmd_ptr]) {
-        case '[': {
-            if (special_cmd_ptr == 0) {
-                special_cmd = 1;
-            }
-            else {
-                special_cmd = -1;
-            }
+/* Input decoding */
+typedef enum {
+    CLI_KEY_NONE = 0,
+    CLI_KEY_UP,
+    CLI_KEY_DOWN,
+    CLI_KEY_RIGHT,
+    CLI_KEY_LEFT,
+    CLI_KEY_HOME,
+    CLI_KEY_END,
+    CLI_KEY_WORD_RIGHT,
+    CLI_KEY_WORD_LEFT,
+    CLI_KEY_INSERT,
+    CLI_KEY_DELETE,
+    CLI_KEY_BACKSPACE,
+    CLI_KEY_KILL_END,
+    CLI_KEY_KILL_START,
+    CLI_KEY_KILL_WORD,
+    CLI_KEY_PASTE_START,
+    CLI_KEY_PASTE_END,
+    CLI_KEY_INTERRUPT,
+} cli_key_t;
+
+void process_key(cli_key_t key) {
+    switch (key) {
+        case CLI_KEY_UP: up_history(); break;
+        case CLI_KEY_DOWN: down_history(); break;
+        case CLI_KEY_RIGHT: cli_move_cursor(cli_status.current_pos+1); break;
+        case CLI_KEY_LEFT: cli_move_cursor(cli_status.current_pos-1); break;
+        case CLI_KEY_HOME: cli_move_cursor(0); break;
+        case CLI_KEY_END: cli_move_cursor(cli_status.current_length); break;
+        case CLI_KEY_WORD_RIGHT: cli_move_cursor(cli_word_end(cli_status.current_pos)); break;
+        case CLI_KEY_WORD_LEFT: cli_move_cursor(cli_word_start(cli_status.current_pos)); break;
+        case CLI_KEY_INSERT: cli_status.insert = !cli_status.insert; break;
+        case CLI_KEY_DELETE: cli_remove_range(cli_status.current_pos, cli_status.current_pos+1); break;
+        case CLI_KEY_BACKSPACE: cli_remove_range(cli_status.current_pos-1, cli_status.current_pos); break;
+        case CLI_KEY_KILL_END: cli_remove_range(cli_status.current_pos, cli_status.current_length); break;
+        case CLI_KEY_KILL_START: cli_remove_range(0, cli_status.current_pos); break;
+        case CLI_KEY_KILL_WORD: cli_remove_range(cli_word_start(cli_status.current_pos), cli_status.current_pos); break;
+        case CLI_KEY_PASTE_START: cli_status.paste = true; break;
+        case CLI_KEY_PASTE_END: cli_status.paste = false; break;
+        case CLI_KEY_INTERRUPT: {  // drop the current line
+            cli_move_cursor(cli_status.current_length);
+            cli_output("^C\n");
+            cli_edit_current();
+            memset(cli_status.data[0], 0, CLI_MAX_LENGTH);
+            cli_status.current_length = 0;
+            cli_status.current_pos = 0;
+            draw_cli();
         }
         break;
-        case '2': {  // followed by '~' is insert
-            if (special_cmd_ptr != 1) {
-                special_cmd = -1;
-            }
+        default: break;
+    }
+}
+
+#if CLI_ANSI_ESCAPE_CODE_ENABLED==1
+/* VT100/xterm escape sequences: ESC, an introducer ('[' for CSI, 'O' for SS3, none for
+   Alt+key), optional numeric parameters, and a final byte. */
+struct cli_escape_seq_s {
+    char intro;
+    const char* params;
+    char final;
+    cli_key_t key;
+};
+static const struct cli_escape_seq_s cli_escape_seqs[] = {
+    { '[',  "",     'A', CLI_KEY_UP },
+    { '[',  "",     'B', CLI_KEY_DOWN },
+    { '[',  "",     'C', CLI_KEY_RIGHT },
+    { '[',  "",     'D', CLI_KEY_LEFT },
+    { '[',  "",     'H', CLI_KEY_HOME },
+    { '[',  "",     'F', CLI_KEY_END },
+    { '[',  "1",    '~', CLI_KEY_HOME },
+    { '[',  "7",    '~', CLI_KEY_HOME },
+    { '[',  "4",    '~', CLI_KEY_END },
+    { '[',  "8",    '~', CLI_KEY_END },
+    { '[',  "2",    '~', CLI_KEY_INSERT },
+    { '[',  "3",    '~', CLI_KEY_DELETE },
+    { '[',  "1;5",  'C', CLI_KEY_WORD_RIGHT },
+    { '[',  "1;5",  'D', CLI_KEY_WORD_LEFT },
+    { '[',  "1;3",  'C', CLI_KEY_WORD_RIGHT },
+    { '[',  "1;3",  'D', CLI_KEY_WORD_LEFT },
+    { '[',  "200",  '~', CLI_KEY_PASTE_START },
+    { '[',  "201",  '~', CLI_KEY_PASTE_END },
+    { 'O',  "",     'A', CLI_KEY_UP },
+    { 'O',  "",     'B', CLI_KEY_DOWN },
+    { 'O',  "",     'C', CLI_KEY_RIGHT },
+    { 'O',  "",     'D', CLI_KEY_LEFT },
+    { 'O',  "",     'H', CLI_KEY_HOME },
+    { 'O',  "",     'F', CLI_KEY_END },
+    { '\0', "",     'b', CLI_KEY_WORD_LEFT },
+    { '\0', "",     'f', CLI_KEY_WORD_RIGHT },
+    { '\0', "",     0x7f, CLI_KEY_KILL_WORD },
+};
+
+static const cli_key_t cli_control_keys[0x20] = {
+    [0x01] = CLI_KEY_HOME,        // Ctrl-A
+    [0x02] = CLI_KEY_LEFT,        // Ctrl-B
+    [0x04] = CLI_KEY_DELETE,      // Ctrl-D
+    [0x05] = CLI_KEY_END,         // Ctrl-E
+    [0x06] = CLI_KEY_RIGHT,       // Ctrl-F
+    [0x0B] = CLI_KEY_KILL_END,    // Ctrl-K
+    [0x0E] = CLI_KEY_DOWN,        // Ctrl-N
+    [0x10] = CLI_KEY_UP,          // Ctrl-P
+    [0x15] = CLI_KEY_KILL_START,  // Ctrl-U
+    [0x17] = CLI_KEY_KILL_WORD,   // Ctrl-W
+};
+
+enum cli_escape_state_e {
+    ESC_STATE_NONE = 0,
+    ESC_STATE_ESC,
+    ESC_STATE_SEQ,
+};
+
+cli_key_t lookup_escape_seq(char intro, char final) {
+    for (int i=0 ; i<sizeof(cli_escape_seqs)/sizeof(cli_escape_seqs[0]) ; i++) {
+        const struct cli_escape_seq_s* seq = &cli_escape_seqs[i];
+        if ( seq->intro == intro  &&  seq->final == final  &&  strcmp(seq->params, cli_status.esc.params) == 0 ) {
+            return seq->key;
         }
-        case '3': {  // followed by '~' is delete
-            if (special_cmd_ptr != 1) {
-                special_cmd = -1;
+    }
+    return CLI_KEY_NONE;
+}
+
+/* Returns true if the character was consumed by the escape sequence decoder */
+bool process_escape_char(uint8_t val) {
+    switch (cli_status.esc.state) {
+        case ESC_STATE_NONE: {
+            if (val != 0x1b) {
+                return false;
             }
+            cli_status.esc.state = ESC_STATE_ESC;
+            cli_status.esc.params_len = 0;
+            cli_status.esc.params[0] = '\0';
         }
         break;
-        case '~': {
-            if (special_cmd_ptr == 2  &&  special_cmd_str[1] == '2') {  // insert
-                cli_status.insert = !cli_status.insert;
-                special_cmd = 2;
-            }
-            else if (special_cmd_ptr == 2  &&  special_cmd_str[1] == '3') {  // delete
-                cli_remove_char_at(cli_status.current_pos, false);
-                special_cmd = 2;
+        case ESC_STATE_ESC: {
+            if (val == '['  ||  val == 'O') {
+                cli_status.esc.intro = val;
+                cli_status.esc.state = ESC_STATE_SEQ;
             }
             else {
-                special_cmd = -1;
+                cli_status.esc.state = ESC_STATE_NONE;
+                process_key(lookup_escape_seq('\0', val));
             }
         }
         break;
-        case 'A': {  // up arrow
-            up_history();
-            special_cmd = 2;
-        }
-        break;
-        case 'B': {  // down arrow
-            down_history();
-            special_cmd = 2;
-        }
-        break;
-        case 'C': {  // right arrow
-            if (cli_status.current_pos < cli_status.current_length) {
-                cli_status.current_pos++;
+        case ESC_STATE_SEQ: {
+            if (('0' <= val  &&  val <= '9')  ||  val == ';') {
+                if (cli_status.esc.params_len < sizeof(cli_status.esc.params)-1) {
+                    cli_status.esc.params[cli_status.esc.params_len++] = val;
+                    cli_status.esc.params[cli_status.esc.params_len] = '\0';
+                }
+                else {  // too long for any known sequence, drop it
+                    cli_status.esc.state = ESC_STATE_NONE;
+                }
             }
-            special_cmd = 2;
-        }
-        break;
-        case 'D': {  // left arrow
-            if (cli_status.current_pos > 0) {
-                cli_status.current_pos--;
+            else {
+                cli_status.esc.state = ESC_STATE_NONE;
+                if (0x40 <= val  &&  val <= 0x7e) {
+                    process_key(lookup_escape_seq(cli_status.esc.intro, val));
+                }
             }
-            special_cmd = 2;
-        }
-        break;
-        case 0xff: {
-            special_cmd_ptr--;  // ignore this character
-        }
-        break;
-        default: {
-            special_cmd = -1;
         }
         break;
     }
+    return true;
+}
 
-    special_cmd_ptr++;
+/* Characters received between ESC[200~ and ESC[201~ are inserted in one edit per line */
+void flush_paste(void) {
+    cli_insert_str_at(cli_status.current_pos, cli_status.paste_buff, cli_status.paste_len, cli_status.insert);
+    cli_status.paste_len = 0;
+}
 
-    if (special_cmd == 2) {  // special command was executed, forget characters
-        special_cmd_ptr = SPECIAL_CMD_MAX_LEN;
+void process_paste_char(uint8_t val) {
+    if (val == 0x0A) {
+        flush_paste();
+        parse_cmd_line();
+        return;
     }
-    else if (special_cmd == -1) {  // the string was not a special command
-        for (int i=0 ; i<special_cmd_ptr ; i++) {
-            cli_add_char_at(cli_status.current_pos, special_cmd_str[i], cli_status.insert);
-        }
-        special_cmd_ptr = SPECIAL_CMD_MAX_LEN;
+    if (val == 0x09) {
+        val = ' ';
     }
-
-    if (special_cmd_ptr == SPECIAL_CMD_MAX_LEN) {  // too many characters for a special command or command done
-        for (int i=0 ; i<SPECIAL_CMD_MAX_LEN ; i++) {
-            special_cmd_str[i] = 0;
+    if (0x20 <= val  &&  val < 0x7f) {
+        cli_status.paste_buff[cli_status.paste_len++] = val;
+        if (cli_status.paste_len == CLI_MAX_LENGTH) {
+            flush_paste();
         }
-        special_cmd_ptr = 0;
-        special_cmd = 0;
-        redraw_cli();
     }
-
-    return special_cmd;
 }
-#else
-int process_special_command(uint8_t val) { return 0; }
 #endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
 
 void process_char(uint8_t val) {
-    static int special_cmd = 0;
     static int tab_count = 0;
 
-    if (val == 0x08) {  // backspace
-        cli_remove_char_at(cli_status.current_pos-1, true);
+    if (val == 0xff) {  // nothing received
+        return;
     }
 
+#if CLI_ANSI_ESCAPE_CODE_ENABLED==1
+    bool paste = cli_status.paste;
+    if (process_escape_char(val)) {
+        if (paste  &&  !cli_status.paste) {  // end of bracketed paste
+            flush_paste();
+        }
+        return;
+    }
+    if (cli_status.paste) {
+        process_paste_char(val);
+        return;
+    }
+#endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
+
     if (val == 0x09) {  // tab
         tab_count++;
         tab_count = autocomplete(tab_count);
     }
-    else if (0x01 <= val  &&  val <= 0xfe) {
+    else {
         tab_count = 0;
     }
 
-    if (val == 0x0A) {  // new line
+    if (val == 0x08  ||  val == 0x7f) {  // backspace
+        process_key(CLI_KEY_BACKSPACE);
+    }
+    else if (val == 0x03) {  // Ctrl-C
+        process_key(CLI_KEY_INTERRUPT);
+    }
+    else if (val == 0x0A) {  // new line
         parse_cmd_line();
     }
-
-    if (val == 0x0D) {  // carriage return
+    else if (val == 0x0D) {  // carriage return
         cli_printf("Carriage return\n");
     }
-
-#if CLI_ANSI_ESCAPE_CODE_ENABLED==1
-    if (val == '[') {
-        special_cmd = 1;
-    }
-    else
-#endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
-    if (0x20 <= val  &&  val <= 0x7f) {
-        if (!special_cmd) {
-            cli_add_char_at(cli_status.current_pos, val, cli_status.insert);
-        }
+    else if (0x20 <= val  &&  val < 0x7f) {
+        cli_add_char_at(cli_status.current_pos, val, cli_status.insert);
     }
-
 #if CLI_ANSI_ESCAPE_CODE_ENABLED==1
-    if (special_cmd) {
-        special_cmd = process_special_command(val);
+    else if (val < 0x20) {
+        process_key(cli_control_keys[val]);
     }
 #endif //CLI_ANSI_ESCAPE_CODE_ENABLED==1
 }
@@ -546,8 +921,19 @@ void process_char(uint8_t val) {
 /* CLI task */
 void cli_task() {
     while (1) {
-        uint8_t in = getchar();
+#if CLI_SESSION_ENABLED==1
+        session_replay_pending();
+#endif //CLI_SESSION_ENABLED==1
+#if CLI_COOP_ENABLED==1
+        TickType_t idle = cli_coop_run_jobs(pdMS_TO_TICKS(20));
+#else
+        TickType_t idle = pdMS_TO_TICKS(20);
+#endif //CLI_COOP_ENABLED==1
+        int in = cli_getchar();
+        if (in == EOF) {  // only wait when there is no pending input, so pasted text is not character-paced
+            vTaskDelay(idle);
+            continue;
+        }
         process_char(in);
-        vTaskDelay(pdMS_TO_TICKS(20));
     }
 }
@@ -4,6 +4,8 @@
 
 #include "esp_system.h"
 #include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
 
 
 typedef int (*flush_fc_t)(void);
@@ -34,5 +36,16 @@ void esp_cli_init(cli_init_t init);
 int cli_printf(const char* format, ...);
 int cli_vprintf(const char* format, va_list args);
 
+typedef struct cli_capture_s {
+    struct cli_capture_s* next;
+    TaskHandle_t task;
+    char* buff;
+    size_t size;
+    size_t len;
+} cli_capture_t;
+
+void cli_capture_begin(cli_capture_t* capture, char* buff, size_t size);
+size_t cli_capture_end(cli_capture_t* capture);
+
 
 #endif //CLI_H__
@@ -0,0 +1,117 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_BENCH_ENABLED)
+
+#include <stdlib.h>
+#include <stdatomic.h>
+
+#include "cli_bench.h"
+
+
+// for benchmarks that take almost no time
+#define CLI_BENCH_MAX_ITERATIONS (1 << 24)
+
+#define CLI_BENCH_MAX_SCALE 100
+
+#if defined(ESP_PLATFORM)
+extern cli_bench_info_t __cli_benches_start[], __cli_benches_end[];
+#define CLI_BENCH_START __cli_benches_start
+#define CLI_BENCH_END __cli_benches_end
+#else
+// weak, so a host build without any benchmark still links
+extern cli_bench_info_t __start_cli_benches[] __attribute__((weak)), __stop_cli_benches[] __attribute__((weak));
+#define CLI_BENCH_START __start_cli_benches
+#define CLI_BENCH_END __stop_cli_benches
+#endif
+
+static atomic_flag bench_running = ATOMIC_FLAG_INIT;
+
+
+void cli_bench_foreach(cli_bench_cb_t cb, void* arg) {
+    for (const cli_bench_info_t* info=CLI_BENCH_START ; info<CLI_BENCH_END ; info++) {
+        if ( !cb(info, arg) ) {
+            return;
+        }
+    }
+}
+
+static uint32_t bench_sample(cli_bench_t* bench, uint32_t iterations) {
+    uint32_t start = CLI_BENCH_CYCLES();
+    bench->info->funct(bench, iterations);
+    return CLI_BENCH_CYCLES() - start;
+}
+
+/* Doubles the iterations at least, until a sample takes the target time */
+static uint32_t bench_scale(cli_bench_t* bench, uint32_t target) {
+    uint32_t iterations = 1;
+    while ( iterations < CLI_BENCH_MAX_ITERATIONS ) {
+        uint32_t cycles = bench_sample(bench, iterations);
+        if ( cycles >= target ) {
+            break;
+        }
+        uint64_t next = cycles > 0 ? (uint64_t)iterations * target / cycles * 5 / 4 : (uint64_t)iterations * CLI_BENCH_MAX_SCALE;
+        if ( next < 2*(uint64_t)iterations ) {
+            next = 2*(uint64_t)iterations;
+        }
+        if ( next > (uint64_t)iterations * CLI_BENCH_MAX_SCALE ) {
+            next = (uint64_t)iterations * CLI_BENCH_MAX_SCALE;
+        }
+        iterations = next < CLI_BENCH_MAX_ITERATIONS ? next : CLI_BENCH_MAX_ITERATIONS;
+    }
+    return iterations;
+}
+
+static int bench_compare(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*)a;
+    uint32_t y = *(const uint32_t*)b;
+    return x < y ? -1 : x > y;
+}
+
+/* Only one benchmark runs at a time, so they do not disturb each other */
+esp_err_t cli_bench_run(const cli_bench_info_t* info, const cli_bench_opts_t* opts, cli_bench_result_t* result) {
+    if ( opts->samples == 0  ||  opts->samples > CLI_BENCH_MAX_SAMPLES  ||  opts->sample_us == 0  ||  opts->sample_us > CLI_BENCH_MAX_SAMPLE_US ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( atomic_flag_test_and_set(&bench_running) ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    cli_bench_t bench = { .info = info, .data = NULL };
+    if ( info->setup != NULL  &&  !info->setup(&bench) ) {
+        atomic_flag_clear(&bench_running);
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t err = ESP_OK;
+    uint32_t iterations = bench_scale(&bench, opts->sample_us * CLI_BENCH_CYCLES_PER_US());
+    uint32_t samples[CLI_BENCH_MAX_SAMPLES];
+    for (int i=-(int)opts->warmup ; i<(int)opts->samples ; i++) {
+        if ( opts->cancelled != NULL  &&  opts->cancelled() ) {
+            err = ESP_FAIL;
+            break;
+        }
+        uint32_t cycles = bench_sample(&bench, iterations);
+        if ( i >= 0 ) {
+            samples[i] = (cycles + iterations/2) / iterations;
+        }
+    }
+
+    if ( info->teardown != NULL ) {
+        info->teardown(&bench);
+    }
+    atomic_flag_clear(&bench_running);
+    if ( err != ESP_OK ) {
+        return err;
+    }
+
+    qsort(samples, opts->samples, sizeof(uint32_t), bench_compare);
+    result->iterations = iterations;
+    result->samples = opts->samples;
+    result->min = samples[0];
+    result->median = samples[opts->samples/2];
+    result->p99 = samples[(opts->samples*99 + 99)/100 - 1];  // nearest rank
+    return ESP_OK;
+}
+
+#endif //CONFIG_CLI_BENCH_ENABLED
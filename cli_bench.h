@@ -0,0 +1,93 @@
+#ifndef CLI_BENCH_H__
+#define CLI_BENCH_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+
+/* Cycle counter of the running core. The host build counts nanoseconds instead. */
+#if defined(ESP_PLATFORM)
+#include "xtensa/hal.h"
+#include "rom/ets_sys.h"
+#define CLI_BENCH_CYCLES() xthal_get_ccount()
+#define CLI_BENCH_CYCLES_PER_US() ets_get_cpu_frequency()
+#define CLI_BENCH_SECTION ".cli.benches"
+#else
+#include <time.h>
+static inline uint32_t cli_bench_host_cycles(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((uint64_t)now.tv_sec*1000000000 + now.tv_nsec);
+}
+#define CLI_BENCH_CYCLES() cli_bench_host_cycles()
+#define CLI_BENCH_CYCLES_PER_US() 1000
+// a section name that is a C identifier gets __start_/__stop_ symbols from the host linker
+#define CLI_BENCH_SECTION "cli_benches"
+#endif
+
+
+typedef struct cli_bench_s cli_bench_t;
+
+typedef struct cli_bench_info_s {
+    const char *name;
+    void (*funct)(cli_bench_t*, uint32_t);
+    bool (*setup)(cli_bench_t*);            // false to skip the benchmark
+    void (*teardown)(cli_bench_t*);
+    uint32_t param;
+    uint32_t bytes;                         // processed by each iteration, to report a throughput
+} cli_bench_info_t;
+
+struct cli_bench_s {
+    const cli_bench_info_t* info;
+    void* data;                             // set by the setup
+};
+
+// Optional fields can be given as designated initializers, e.g. `.bytes = 4096`.
+// The alignment keeps the compiler from padding the entries of the section.
+#define CLI_BENCH_DECLARE(bench_name, ...)  \
+            static const char __cli_bench__name__##bench_name[] = #bench_name;  \
+            static void __attribute__((__used__)) __cli_bench__funct__##bench_name(cli_bench_t*, uint32_t);  \
+            static cli_bench_info_t __cli_bench__info__##bench_name __attribute__((__used__)) __attribute__((__section__(CLI_BENCH_SECTION)))  \
+                __attribute__((__aligned__(__alignof__(cli_bench_info_t))))  \
+                = { .name = __cli_bench__name__##bench_name, .funct = __cli_bench__funct__##bench_name, __VA_ARGS__ };  \
+            static void __attribute__((__used__)) __cli_bench__funct__##bench_name(cli_bench_t* bench, uint32_t iterations)
+
+#define CLI_BENCH(bench_name) CLI_BENCH_DECLARE(bench_name)
+
+// Keeps the compiler from optimizing away a result that is never used
+#define CLI_BENCH_KEEP(value) __asm__ __volatile__("" : : "r"(value) : "memory")
+
+
+#define CLI_BENCH_MAX_SAMPLES 256
+
+// keeps the samples far from the wrap of the 32 bit counter
+#define CLI_BENCH_MAX_SAMPLE_US 1000000
+
+typedef struct {
+    uint32_t samples;                       // measured samples
+    uint32_t warmup;                        // samples run and dropped before measuring
+    uint32_t sample_us;                     // target duration of a sample
+    bool (*cancelled)(void);                // optional, checked between samples
+} cli_bench_opts_t;
+
+#define CLI_BENCH_OPTS_DEFAULT() { .samples = 100, .warmup = 5, .sample_us = 1000, .cancelled = NULL }
+
+/* Cycles per iteration, over the samples */
+typedef struct {
+    uint32_t iterations;                    // per sample
+    uint32_t samples;
+    uint32_t min;
+    uint32_t median;
+    uint32_t p99;
+} cli_bench_result_t;
+
+
+typedef bool (*cli_bench_cb_t)(const cli_bench_info_t* info, void* arg);
+
+void cli_bench_foreach(cli_bench_cb_t cb, void* arg);
+esp_err_t cli_bench_run(const cli_bench_info_t* info, const cli_bench_opts_t* opts, cli_bench_result_t* result);
+
+
+#endif //CLI_BENCH_H__
@@ -0,0 +1,40 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_STATS_ENABLED)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "cli_stats.h"
+
+
+struct cli_stats_counters_s cli_stats_counters;
+
+
+void cli_stats_get(cli_stats_t* stats) {
+#define CLI_STATS_LOAD(name) stats->name = atomic_load_explicit(&cli_stats_counters.name, memory_order_relaxed);
+    CLI_STATS_FIELDS(CLI_STATS_LOAD)
+#undef CLI_STATS_LOAD
+}
+
+void cli_stats_reset(void) {
+#define CLI_STATS_CLEAR(name) atomic_store_explicit(&cli_stats_counters.name, 0, memory_order_relaxed);
+    CLI_STATS_FIELDS(CLI_STATS_CLEAR)
+#undef CLI_STATS_CLEAR
+}
+
+/* Single line JSON object, e.g. {"commands_run":12,"commands_failed":1,...} */
+int cli_stats_json(const cli_stats_t* stats, char* buff, size_t size) {
+    int len = 0;
+    const char* sep = "{";
+#define CLI_STATS_PRINT(name)  \
+            len += snprintf(len < size ? buff+len : NULL, len < size ? size-len : 0, "%s\"" #name "\":%u", sep, (unsigned)stats->name);  \
+            sep = ",";
+    CLI_STATS_FIELDS(CLI_STATS_PRINT)
+#undef CLI_STATS_PRINT
+    len += snprintf(len < size ? buff+len : NULL, len < size ? size-len : 0, "}");
+    return len;
+}
+
+#endif //CONFIG_CLI_STATS_ENABLED
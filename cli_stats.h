@@ -0,0 +1,47 @@
+#ifndef CLI_STATS_H__
+#define CLI_STATS_H__
+
+#include <stdatomic.h>
+#include "esp_system.h"
+#include "sdkconfig.h"
+
+
+// X-macro list of the counters, in the order they are reported
+#define CLI_STATS_FIELDS(X)  \
+            X(commands_run)  \
+            X(commands_failed)  \
+            X(commands_not_found)  \
+            X(commands_async_timeout)  \
+            X(commands_timeout)  \
+            X(commands_cancelled)  \
+            X(output_bytes)  \
+            X(redraws)  \
+            X(log_lines)
+
+#define CLI_STATS_SNAPSHOT_FIELD(name) uint32_t name;
+typedef struct {
+    CLI_STATS_FIELDS(CLI_STATS_SNAPSHOT_FIELD)
+} cli_stats_t;
+
+#define CLI_STATS_COUNTER_FIELD(name) atomic_uint_least32_t name;
+struct cli_stats_counters_s {
+    CLI_STATS_FIELDS(CLI_STATS_COUNTER_FIELD)
+};
+
+#if defined(CONFIG_CLI_STATS_ENABLED)
+extern struct cli_stats_counters_s cli_stats_counters;
+// Counters are only ever summed, so the add is relaxed: no fence, but still an atomic
+// read-modify-write (a compare-and-swap loop with S32C1I on Xtensa). They are 32 bit, so
+// no lock is needed, and they wrap around.
+#define CLI_STATS_ADD(name, value) atomic_fetch_add_explicit(&cli_stats_counters.name, (value), memory_order_relaxed)
+#else
+#define CLI_STATS_ADD(name, value) ((void)0)
+#endif
+
+
+void cli_stats_get(cli_stats_t* stats);
+void cli_stats_reset(void);
+int cli_stats_json(const cli_stats_t* stats, char* buff, size_t size);
+
+
+#endif //CLI_STATS_H__
@@ -0,0 +1,201 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_COOP_ENABLED)
+
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "cmd_coop.h"
+#include "cmd_create.h"
+
+
+#define CLI_COOP_JOBS CONFIG_CLI_COOP_JOBS
+
+#define CLI_COOP_STATE_SIZE CONFIG_CLI_COOP_STATE_SIZE
+
+#define CLI_COOP_MAX_ARGS 8
+
+#define CLI_COOP_MAX_LENGTH CONFIG_CLI_MAX_LEN
+
+#define CLI_COOP_POLL_MS 20
+
+
+enum cli_coop_job_state_e {
+    CLI_COOP_JOB_FREE = 0,
+    CLI_COOP_JOB_STARTING,
+    CLI_COOP_JOB_RUNNING,
+};
+
+/* A background job costs this struct instead of a task and its stack */
+struct cli_coop_job_s {
+    uint64_t state[(CLI_COOP_STATE_SIZE+7)/8];
+    cli_coop_t co;
+    cli_funct_info_t info;
+    int id;
+    uint8_t job_state;
+    int argc;
+    char* argv[CLI_COOP_MAX_ARGS+1];
+    char command[CLI_COOP_MAX_LENGTH+1];
+};
+static struct cli_coop_job_s coop_jobs[CLI_COOP_JOBS];
+static int coop_next_id = 1;
+static portMUX_TYPE coop_jobs_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+static bool coop_due(const cli_coop_t* co, TickType_t now) {
+    return co->cancelled  ||  (int32_t)(now - co->wake) >= 0;
+}
+
+/* Runs a cooperative command to completion on the calling task. Between its steps the
+   task blocks until the next one is due. On the tasks of the CLI (notified), it waits for
+   a notification, so a cancellation wakes it early; the notifications of a caller's task
+   are left alone, and it only sleeps. While it waits, poll is called (to read the input
+   and run the background jobs when on the CLI task). */
+int cli_coop_run(const cli_funct_info_t* info, int argc, char** argv, bool (*poll)(bool), volatile bool* cancelled, bool notified) {
+    uint64_t state[info->coop_state_size > 0 ? (info->coop_state_size+7)/8 : 1];
+    memset(state, 0, sizeof(state));
+    cli_coop_t co = { .line = 0, .wake = 0, .cancelled = false, .state = state };
+
+    while (1) {
+        int ret = info->coop_funct(&co, argc, argv);
+        if ( ret != CLI_COOP_RUNNING ) {
+            return ret;
+        }
+        if ( co.cancelled ) {  // it was given a last step to clean up
+            return CLI_CMD_RETURN_CANCELLED;
+        }
+
+        while (1) {
+            if ( poll != NULL  &&  poll(false) ) {
+                co.cancelled = true;
+            }
+            if ( cancelled != NULL  &&  *cancelled ) {
+                co.cancelled = true;
+            }
+            TickType_t now = xTaskGetTickCount();
+            if ( coop_due(&co, now) ) {
+                break;
+            }
+            TickType_t wait = co.wake - now;
+            if ( poll != NULL  &&  wait > pdMS_TO_TICKS(CLI_COOP_POLL_MS) ) {
+                wait = pdMS_TO_TICKS(CLI_COOP_POLL_MS);
+            }
+            if ( notified ) {
+                ulTaskNotifyTake(pdTRUE, wait > 0 ? wait : 1);
+            }
+            else {
+                vTaskDelay(wait > 0 ? wait : 1);
+            }
+        }
+    }
+}
+
+
+/* Background jobs, run by the CLI task */
+int cli_coop_start(const cli_funct_info_t* info, int argc, char** argv) {
+    if ( argc > CLI_COOP_MAX_ARGS  ||  info->coop_state_size > CLI_COOP_STATE_SIZE ) {
+        return CLI_CMD_RETURN_RUNTIME_ERROR;
+    }
+    int len = 0;
+    for (int i=0 ; i<argc ; i++) {
+        len += strlen(argv[i])+1;
+    }
+    if ( len > sizeof(coop_jobs[0].command) ) {
+        return CLI_CMD_RETURN_RUNTIME_ERROR;
+    }
+
+    struct cli_coop_job_s* job = NULL;
+    portENTER_CRITICAL(&coop_jobs_mux);
+    for (int i=0 ; i<CLI_COOP_JOBS ; i++) {
+        if ( coop_jobs[i].job_state == CLI_COOP_JOB_FREE ) {
+            job = &coop_jobs[i];
+            job->job_state = CLI_COOP_JOB_STARTING;
+            job->id = coop_next_id++;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&coop_jobs_mux);
+    if ( job == NULL ) {
+        return CLI_CMD_RETURN_RUNTIME_ERROR;
+    }
+
+    job->info = *info;
+    char* out = job->command;
+    for (int i=0 ; i<argc ; i++) {
+        job->argv[i] = out;
+        strcpy(out, argv[i]);
+        out += strlen(argv[i])+1;
+    }
+    job->argv[argc] = NULL;
+    job->argc = argc;
+    memset(job->state, 0, sizeof(job->state));
+    job->co.line = 0;
+    job->co.wake = xTaskGetTickCount();
+    job->co.cancelled = false;
+    job->co.state = job->state;
+
+    portENTER_CRITICAL(&coop_jobs_mux);
+    job->job_state = CLI_COOP_JOB_RUNNING;
+    portEXIT_CRITICAL(&coop_jobs_mux);
+    return CLI_CMD_RETURN_OK;
+}
+
+/* Runs one step of each job that is due. Returns how long the caller can wait before the
+   next step is due, at least 1 tick and at most max_wait. */
+TickType_t cli_coop_run_jobs(TickType_t max_wait) {
+    TickType_t wait = max_wait;
+    for (int i=0 ; i<CLI_COOP_JOBS ; i++) {
+        struct cli_coop_job_s* job = &coop_jobs[i];
+        if ( job->job_state != CLI_COOP_JOB_RUNNING ) {
+            continue;
+        }
+        TickType_t now = xTaskGetTickCount();
+        if ( coop_due(&job->co, now) ) {
+            bool cancelled = job->co.cancelled;
+            int ret = job->info.coop_funct(&job->co, job->argc, job->argv);
+            if ( ret != CLI_COOP_RUNNING  ||  cancelled ) {
+                portENTER_CRITICAL(&coop_jobs_mux);
+                job->job_state = CLI_COOP_JOB_FREE;
+                portEXIT_CRITICAL(&coop_jobs_mux);
+                continue;
+            }
+            now = xTaskGetTickCount();
+        }
+        TickType_t job_wait = coop_due(&job->co, now) ? 0 : job->co.wake - now;
+        if ( job_wait < wait ) {
+            wait = job_wait;
+        }
+    }
+    return wait > 0 ? wait : 1;
+}
+
+void cli_coop_foreach(cli_coop_job_cb_t cb, void* arg) {
+    for (int i=0 ; i<CLI_COOP_JOBS ; i++) {
+        portENTER_CRITICAL(&coop_jobs_mux);
+        bool running = coop_jobs[i].job_state == CLI_COOP_JOB_RUNNING;
+        int id = coop_jobs[i].id;
+        const char* name = coop_jobs[i].info.name;
+        portEXIT_CRITICAL(&coop_jobs_mux);
+        if ( running  &&  !cb(id, name, arg) ) {
+            return;
+        }
+    }
+}
+
+esp_err_t cli_coop_cancel(int id) {
+    esp_err_t err = ESP_ERR_NOT_FOUND;
+    portENTER_CRITICAL(&coop_jobs_mux);
+    for (int i=0 ; i<CLI_COOP_JOBS ; i++) {
+        if ( coop_jobs[i].job_state == CLI_COOP_JOB_RUNNING  &&  coop_jobs[i].id == id ) {
+            coop_jobs[i].co.cancelled = true;
+            err = ESP_OK;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&coop_jobs_mux);
+    return err;
+}
+
+#endif //CONFIG_CLI_COOP_ENABLED
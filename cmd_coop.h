@@ -0,0 +1,20 @@
+#ifndef CMD_COOP_H__
+#define CMD_COOP_H__
+
+#include "freertos/FreeRTOS.h"
+#include "esp_err.h"
+
+#include "cmd_create.h"
+
+
+int cli_coop_run(const cli_funct_info_t* info, int argc, char** argv, bool (*poll)(bool any_key), volatile bool* cancelled, bool notified);
+
+int cli_coop_start(const cli_funct_info_t* info, int argc, char** argv);
+TickType_t cli_coop_run_jobs(TickType_t max_wait);
+
+typedef bool (*cli_coop_job_cb_t)(int id, const char* name, void* arg);
+void cli_coop_foreach(cli_coop_job_cb_t cb, void* arg);
+esp_err_t cli_coop_cancel(int id);
+
+
+#endif //CMD_COOP_H__
@@ -4,33 +4,129 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "esp_err.h"
+#include "sdkconfig.h"
 
 #include <string.h>
+#include <limits.h>
 
 
+/* Execution context of a cooperative command, kept between its steps */
+typedef struct cli_coop_s {
+    int line;                   // resume point, 0 to start
+    TickType_t wake;            // tick at which the next step is due
+    volatile bool cancelled;
+    void* state;                // zeroed before the first step
+} cli_coop_t;
+
 typedef struct cli_funct_info_s {
     const char *name;
     int stack_size;
     int priority;
     int (*funct)(int, char**);
+    int timeout_ms;
+    uint32_t flags;
+    int (*coop_funct)(cli_coop_t*, int, char**);
+    int coop_state_size;
+    int core;
 } cli_funct_info_t;
 
-#define CLI_CMD_DECLARE(command, stack, pri)  \
+// The command can be run on the caller's task with CLI_CALL(), so it must not need a large stack
+#define CLI_CMD_FLAG_IN_CALLER                     (1 << 0)
+
+#if defined(CONFIG_CLI_STATIC_ALLOCATION)
+// Commands run on statically allocated tasks, whose stack must fit every command
+#define CLI_CMD_STACK_MAX CONFIG_CLI_STATIC_CMD_STACK
+#else
+#define CLI_CMD_STACK_MAX INT_MAX
+#endif
+
+// Optional fields can be given as designated initializers, e.g. `.timeout_ms = 5000`.
+// The alignment keeps the compiler from padding the entries of the section.
+#define CLI_CMD_DECLARE(command, stack, pri, ...)  \
+            _Static_assert((stack) <= CLI_CMD_STACK_MAX, "The stack of the command '" #command "' is larger than CONFIG_CLI_STATIC_CMD_STACK");  \
             static const char __cli_cmd__name__##command[] __attribute__((__section__(".rodata"))) = #command;  \
             static int __attribute__((__used__)) __cli_cmd__funct__##command(int, char**);  \
             static cli_funct_info_t __cli_cmd__info__##command __attribute__((__used__)) __attribute__((__section__(".cli.commands")))  \
-                = {__cli_cmd__name__##command, stack, pri, __cli_cmd__funct__##command};  \
+                __attribute__((__aligned__(__alignof__(cli_funct_info_t))))  \
+                = { .name = __cli_cmd__name__##command, .stack_size = stack, .priority = pri, .funct = __cli_cmd__funct__##command, __VA_ARGS__ };  \
             static int __attribute__((__used__)) __cli_cmd__funct__##command(int argc, char** argv)
 
 #define CLI_CMD(command) CLI_CMD_DECLARE(command, 2048, 10)
 #define CLI_CMD_STACK(command, stack) CLI_CMD_DECLARE(command, stack, 10)
 #define CLI_CMD_PRIORITY(command, priority) CLI_CMD_DECLARE(command, 2048, priority)
 #define CLI_CMD_STACK_PRIORITY(command, stack, priority) CLI_CMD_DECLARE(command, stack, priority)
+#define CLI_CMD_TIMEOUT(command, timeout) CLI_CMD_DECLARE(command, 2048, 10, .timeout_ms = timeout)
+#define CLI_CMD_IN_CALLER(command) CLI_CMD_DECLARE(command, 2048, 10, .flags = CLI_CMD_FLAG_IN_CALLER)
+
+#define CLI_CMD_TIMEOUT_DEFAULT                    0
+#define CLI_CMD_TIMEOUT_NONE                      -1
 
-#define CLI_CMD_MSSLEEP(ms) vTaskDelay( pdMS_TO_TICKS(ms) )
-#define CLI_CMD_SLEEP(s) vTaskDelay( pdMS_TO_TICKS(1000*s) )
+// Core the command task runs on, e.g. `.core = CLI_CMD_CORE_PINNED(1)`
+#define CLI_CMD_CORE_DEFAULT                       0            // CONFIG_CLI_CMD_CORE_POLICY
+#define CLI_CMD_CORE_ANY                          -1
+#define CLI_CMD_CORE_IDLE                         -2            // the core that was the most idle lately
+#define CLI_CMD_CORE_PINNED(core)                  ((core)+1)
 
 
+/* Cooperative commands run as stackless coroutines, inside the CLI task when possible.
+   Local variables are lost at each CLI_COOP_YIELD()/CLI_COOP_SLEEP_MS()/CLI_COOP_WAIT_UNTIL(),
+   so anything kept across them goes in the state, and they cannot be used inside a switch. */
+#if defined(CONFIG_CLI_COOP_ENABLED)
+#define CLI_CMD_COOP(command, state_type)  \
+            _Static_assert(sizeof(state_type) <= CONFIG_CLI_COOP_STATE_SIZE, "The state of the command '" #command "' is larger than CONFIG_CLI_COOP_STATE_SIZE");  \
+            static const char __cli_cmd__name__##command[] __attribute__((__section__(".rodata"))) = #command;  \
+            static int __attribute__((__used__)) __cli_cmd__coop__##command(cli_coop_t*, int, char**);  \
+            static cli_funct_info_t __cli_cmd__info__##command __attribute__((__used__)) __attribute__((__section__(".cli.commands")))  \
+                __attribute__((__aligned__(__alignof__(cli_funct_info_t))))  \
+                = { .name = __cli_cmd__name__##command, .stack_size = 2048, .priority = 10, .flags = CLI_CMD_FLAG_IN_CALLER,  \
+                    .coop_funct = __cli_cmd__coop__##command, .coop_state_size = sizeof(state_type) };  \
+            static int __attribute__((__used__)) __cli_cmd__coop__##command(cli_coop_t* co, int argc, char** argv)
+#else
+#define CLI_CMD_COOP(command, state_type) _Static_assert(0, "Please enable the cooperative commands in menuconfig to use CLI_CMD_COOP")
+#endif
+
+#define CLI_COOP_RUNNING                           0x7fffffff
+
+#define CLI_COOP_BEGIN() switch (co->line) { case 0:
+#define CLI_COOP_END() } co->line = 0; return CLI_CMD_RETURN_OK
+// A command waiting or yielding is run again at the next tick at the earliest, so the
+// tasks of lower priority get to run in between
+#define CLI_COOP_WAIT_UNTIL(cond)  \
+            do {  \
+                co->line = __LINE__; co->wake = xTaskGetTickCount() + 1; case __LINE__:  \
+                if ( !(cond)  &&  !co->cancelled ) { return CLI_COOP_RUNNING; }  \
+            } while (0)
+#define CLI_COOP_YIELD()  \
+            do {  \
+                co->line = __LINE__; co->wake = xTaskGetTickCount() + 1; return CLI_COOP_RUNNING; case __LINE__:;  \
+            } while (0)
+#define CLI_COOP_SLEEP_MS(ms)  \
+            do {  \
+                co->line = __LINE__; co->wake = xTaskGetTickCount() + (pdMS_TO_TICKS(ms) > 0 ? pdMS_TO_TICKS(ms) : 1); return CLI_COOP_RUNNING; case __LINE__:;  \
+            } while (0)
+#define CLI_COOP_CANCELLED() (co->cancelled)
+#define CLI_COOP_STATE(type) ((type*)co->state)
+
+
+bool cli_cmd_cancelled(void);
+bool cli_cmd_sleep_ms(uint32_t ms);
+bool cli_cmd_sleep_until(TickType_t* last_wake, uint32_t period_ms);
+void cli_cmd_cancel_on_key(bool enabled);
+int cli_cmd_getchar(uint32_t timeout_ms);
+
+#define CLI_CMD_CANCELLED() cli_cmd_cancelled()
+#define CLI_CMD_CANCEL_ON_KEY() cli_cmd_cancel_on_key(true)
+#define CLI_CMD_GETCHAR(timeout_ms) cli_cmd_getchar(timeout_ms)
+
+#define CLI_CMD_MSSLEEP(ms) cli_cmd_sleep_ms(ms)
+#define CLI_CMD_SLEEP(s) cli_cmd_sleep_ms(1000*(s))
+#define CLI_CMD_MSSLEEP_UNTIL(last_wake, ms) cli_cmd_sleep_until(last_wake, ms)
+
+
+#define CLI_CMD_RETURN_NOT_IN_CALLER              -0x16
+#define CLI_CMD_RETURN_TIMEOUT                    -0x15
+#define CLI_CMD_RETURN_CANCELLED                  -0x14
 #define CLI_CMD_RETURN_RUNTIME_ERROR              -0x13
 #define CLI_CMD_RETURN_ASYNC_TIMEOUT              -0x12
 #define CLI_CMD_RETURN_CMD_NOT_FOUND              -0x11
@@ -42,6 +138,10 @@ typedef struct cli_funct_info_s {
 
 
 
+esp_err_t cli_register_command(const cli_funct_info_t* info);
+esp_err_t cli_unregister_command(const char* name);
+
+
 bool get_argv_has_option(const char* option, int argc, char* argv[]);
 char* get_argv_option_value(const char* option, int argc, char* argv[]);
 
@@ -0,0 +1,107 @@
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "cmd_placement.h"
+#include "cmd_create.h"
+
+
+#if defined(CONFIG_CLI_CMD_CORE_POLICY_OFF_PROTOCOL)
+#define CLI_CMD_CORE_POLICY CLI_CMD_CORE_PINNED(1-CONFIG_CLI_CMD_PROTOCOL_CORE)
+#elif defined(CONFIG_CLI_CMD_CORE_POLICY_IDLE)
+#define CLI_CMD_CORE_POLICY CLI_CMD_CORE_IDLE
+#else
+#define CLI_CMD_CORE_POLICY CLI_CMD_CORE_ANY
+#endif
+
+#if defined(CONFIG_FREERTOS_USE_TRACE_FACILITY) && defined(CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS)
+#define CLI_PLACEMENT_RUN_TIME_STATS 1
+#else
+#define CLI_PLACEMENT_RUN_TIME_STATS 0
+#endif
+
+
+/* Reads what the selection needs: the idle times only for CLI_CMD_CORE_IDLE, as they
+   can be costly to get */
+void cli_placement_sample(int affinity, const cli_placement_ops_t* ops, cli_placement_sample_t* sample) {
+    if ( affinity == CLI_CMD_CORE_DEFAULT ) {
+        affinity = CLI_CMD_CORE_POLICY;
+    }
+    sample->affinity = affinity;
+    sample->cores = ops->core_count();
+    if ( sample->cores > CLI_PLACEMENT_MAX_CORES ) {
+        sample->cores = CLI_PLACEMENT_MAX_CORES;
+    }
+    sample->idle_valid = affinity == CLI_CMD_CORE_IDLE  &&  sample->cores > 1  &&  ops->idle_time != NULL;
+    for (int core=0 ; sample->idle_valid  &&  core<sample->cores ; core++) {
+        sample->idle_valid = ops->idle_time(core, &sample->idle_time[core]);
+    }
+}
+
+/* Returns the core to run a command on, or tskNO_AFFINITY */
+int cli_placement_choose(const cli_placement_sample_t* sample, cli_placement_t* placement) {
+    if ( sample->affinity > 0 ) {
+        int core = sample->affinity-1;
+        return core < sample->cores ? core : tskNO_AFFINITY;
+    }
+    if ( sample->affinity == CLI_CMD_CORE_IDLE  &&  sample->idle_valid ) {
+        // the core whose idle task ran the most since the previous selection
+        int best = tskNO_AFFINITY;
+        uint32_t best_idle = 0;
+        for (int core=0 ; core<sample->cores ; core++) {
+            uint32_t idle = 0;
+            // a sample taken before the one of a concurrent selection is older than the previous times
+            if ( (int32_t)(sample->idle_time[core] - placement->idle_time[core]) > 0 ) {
+                idle = sample->idle_time[core] - placement->idle_time[core];
+                placement->idle_time[core] = sample->idle_time[core];
+            }
+            if ( best == tskNO_AFFINITY  ||  idle > best_idle ) {
+                best = core;
+                best_idle = idle;
+            }
+        }
+        return best;
+    }
+    return tskNO_AFFINITY;
+}
+
+int cli_placement_select(int affinity, const cli_placement_ops_t* ops, cli_placement_t* placement) {
+    cli_placement_sample_t sample;
+    cli_placement_sample(affinity, ops, &sample);
+    return cli_placement_choose(&sample, placement);
+}
+
+
+/* System placement */
+static int placement_core_count(void) {
+    return portNUM_PROCESSORS;
+}
+
+static bool placement_idle_time(int core, uint32_t* time) {
+#if CLI_PLACEMENT_RUN_TIME_STATS==1
+    TaskStatus_t status;
+    vTaskGetInfo(xTaskGetIdleTaskHandleForCPU(core), &status, pdFALSE, eInvalid);
+    *time = status.ulRunTimeCounter;
+    return true;
+#else
+    return false;
+#endif //CLI_PLACEMENT_RUN_TIME_STATS==1
+}
+
+static const cli_placement_ops_t placement_ops = {
+    .core_count = placement_core_count,
+    .idle_time = placement_idle_time,
+};
+static cli_placement_t placement;
+static portMUX_TYPE placement_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* The ops are called outside of the critical section: vTaskGetInfo() suspends the
+   scheduler, which cannot be done with interrupts disabled */
+int cli_placement_core(int affinity) {
+    cli_placement_sample_t sample;
+    cli_placement_sample(affinity, &placement_ops, &sample);
+    portENTER_CRITICAL(&placement_mux);
+    int core = cli_placement_choose(&sample, &placement);
+    portEXIT_CRITICAL(&placement_mux);
+    return core;
+}
@@ -0,0 +1,35 @@
+#ifndef CMD_PLACEMENT_H__
+#define CMD_PLACEMENT_H__
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+
+
+#define CLI_PLACEMENT_MAX_CORES 2
+
+/* What the placement needs to know about the system, so it can be simulated */
+typedef struct {
+    int (*core_count)(void);
+    bool (*idle_time)(int core, uint32_t* time);   // cumulative run time of the idle task of the core
+} cli_placement_ops_t;
+
+typedef struct {
+    uint32_t idle_time[CLI_PLACEMENT_MAX_CORES];   // at the previous selection
+} cli_placement_t;
+
+/* What the ops returned for a selection, read before the placement is locked */
+typedef struct {
+    int affinity;
+    int cores;
+    bool idle_valid;
+    uint32_t idle_time[CLI_PLACEMENT_MAX_CORES];
+} cli_placement_sample_t;
+
+
+void cli_placement_sample(int affinity, const cli_placement_ops_t* ops, cli_placement_sample_t* sample);
+int cli_placement_choose(const cli_placement_sample_t* sample, cli_placement_t* placement);
+int cli_placement_select(int affinity, const cli_placement_ops_t* ops, cli_placement_t* placement);
+int cli_placement_core(int affinity);
+
+
+#endif //CMD_PLACEMENT_H__
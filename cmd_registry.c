@@ -0,0 +1,223 @@
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include <string.h>
+#include <stdatomic.h>
+
+#include "cmd_registry.h"
+#include "cmd_create.h"
+
+
+#if defined(CONFIG_CLI_DYNAMIC_COMMANDS_MAX)
+#define CLI_DYNAMIC_COMMANDS_MAX CONFIG_CLI_DYNAMIC_COMMANDS_MAX
+#else
+#define CLI_DYNAMIC_COMMANDS_MAX 0
+#endif
+
+
+extern cli_funct_info_t __cli_commands_start[], __cli_commands_end[];
+
+#if CLI_DYNAMIC_COMMANDS_MAX>0
+/* Dynamic commands are published RCU-style: readers pin the current table with a
+   counter and never block, writers fill the spare table and swap the index. */
+struct cli_registry_table_s {
+    atomic_int readers;
+    int count;
+    const cli_funct_info_t* entries[CLI_DYNAMIC_COMMANDS_MAX];
+};
+static struct cli_registry_table_s registry_tables[2];
+static atomic_int registry_current;
+static atomic_flag registry_writer = ATOMIC_FLAG_INIT;
+
+/* The tasks iterating the registry hold a read reference while their callbacks run:
+   a callback that registers or unregisters would wait for its own reference forever,
+   so these tasks are tracked to refuse it. Slots are claimed without a lock, and an
+   iteration only waits for one if more tasks iterate at once. */
+#define CLI_REGISTRY_ITERATORS 4
+static _Atomic(TaskHandle_t) registry_iterators[CLI_REGISTRY_ITERATORS];
+
+
+static struct cli_registry_table_s* registry_read_lock(void) {
+    while (1) {
+        int idx = atomic_load(&registry_current);
+        atomic_fetch_add(&registry_tables[idx].readers, 1);
+        if ( atomic_load(&registry_current) == idx ) {
+            return &registry_tables[idx];
+        }
+        // a writer swapped the tables in the meantime, try again on the new one
+        atomic_fetch_sub(&registry_tables[idx].readers, 1);
+    }
+}
+
+static void registry_read_unlock(struct cli_registry_table_s* table) {
+    atomic_fetch_sub(&table->readers, 1);
+}
+
+static void registry_wait_readers(struct cli_registry_table_s* table) {
+    while ( atomic_load(&table->readers) > 0 ) {
+        vTaskDelay(1);
+    }
+}
+
+static int registry_iterator_enter(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    while (1) {
+        for (int i=0 ; i<CLI_REGISTRY_ITERATORS ; i++) {
+            TaskHandle_t expected = NULL;
+            if ( atomic_compare_exchange_strong(&registry_iterators[i], &expected, task) ) {
+                return i;
+            }
+        }
+        vTaskDelay(1);
+    }
+}
+
+static void registry_iterator_exit(int slot) {
+    atomic_store(&registry_iterators[slot], NULL);
+}
+
+static bool registry_iterating(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    for (int i=0 ; i<CLI_REGISTRY_ITERATORS ; i++) {
+        if ( atomic_load(&registry_iterators[i]) == task ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void registry_write_lock(void) {
+    while ( atomic_flag_test_and_set(&registry_writer) ) {
+        vTaskDelay(1);
+    }
+}
+
+static void registry_write_unlock(void) {
+    atomic_flag_clear(&registry_writer);
+}
+#endif //CLI_DYNAMIC_COMMANDS_MAX>0
+
+
+static bool info_matches(const cli_funct_info_t* info, const char* name, int len) {
+    return strncmp(info->name, name, len) == 0  &&  info->name[len] == '\0';
+}
+
+bool cli_registry_find(const char* name, int len, cli_funct_info_t* info) {
+    for (const cli_funct_info_t* cmd_info=__cli_commands_start ; cmd_info<__cli_commands_end ; cmd_info++) {
+        if ( info_matches(cmd_info, name, len) ) {
+            *info = *cmd_info;
+            return true;
+        }
+    }
+
+#if CLI_DYNAMIC_COMMANDS_MAX>0
+    bool found = false;
+    struct cli_registry_table_s* table = registry_read_lock();
+    for (int i=0 ; i<table->count ; i++) {
+        if ( info_matches(table->entries[i], name, len) ) {
+            *info = *table->entries[i];
+            found = true;
+            break;
+        }
+    }
+    registry_read_unlock(table);
+    return found;
+#else
+    return false;
+#endif //CLI_DYNAMIC_COMMANDS_MAX>0
+}
+
+void cli_registry_foreach(cli_registry_cb_t cb, void* arg) {
+    for (const cli_funct_info_t* cmd_info=__cli_commands_start ; cmd_info<__cli_commands_end ; cmd_info++) {
+        if ( !cb(cmd_info, arg) ) {
+            return;
+        }
+    }
+
+#if CLI_DYNAMIC_COMMANDS_MAX>0
+    int slot = registry_iterator_enter();
+    struct cli_registry_table_s* table = registry_read_lock();
+    for (int i=0 ; i<table->count ; i++) {
+        if ( !cb(table->entries[i], arg) ) {
+            break;
+        }
+    }
+    registry_read_unlock(table);
+    registry_iterator_exit(slot);
+#endif //CLI_DYNAMIC_COMMANDS_MAX>0
+}
+
+
+esp_err_t cli_register_command(const cli_funct_info_t* info) {
+#if CLI_DYNAMIC_COMMANDS_MAX>0
+    if ( info == NULL  ||  info->name == NULL  ||  (info->funct == NULL  &&  info->coop_funct == NULL)  ||  strlen(info->name) == 0 ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( info->stack_size > CLI_CMD_STACK_MAX ) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ( registry_iterating() ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    registry_write_lock();
+    cli_funct_info_t existing;
+    if ( cli_registry_find(info->name, strlen(info->name), &existing) ) {
+        registry_write_unlock();
+        return ESP_ERR_INVALID_STATE;
+    }
+    int current = atomic_load(&registry_current);
+    struct cli_registry_table_s* old_table = &registry_tables[current];
+    struct cli_registry_table_s* new_table = &registry_tables[1-current];
+    if ( old_table->count == CLI_DYNAMIC_COMMANDS_MAX ) {
+        registry_write_unlock();
+        return ESP_ERR_NO_MEM;
+    }
+    registry_wait_readers(new_table);
+    memcpy(new_table->entries, old_table->entries, old_table->count*sizeof(old_table->entries[0]));
+    new_table->entries[old_table->count] = info;
+    new_table->count = old_table->count+1;
+    atomic_store(&registry_current, 1-current);
+    registry_write_unlock();
+
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif //CLI_DYNAMIC_COMMANDS_MAX>0
+}
+
+esp_err_t cli_unregister_command(const char* name) {
+#if CLI_DYNAMIC_COMMANDS_MAX>0
+    if ( name == NULL ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( registry_iterating() ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    registry_write_lock();
+    int current = atomic_load(&registry_current);
+    struct cli_registry_table_s* old_table = &registry_tables[current];
+    struct cli_registry_table_s* new_table = &registry_tables[1-current];
+    registry_wait_readers(new_table);
+    new_table->count = 0;
+    for (int i=0 ; i<old_table->count ; i++) {
+        if ( strcmp(old_table->entries[i]->name, name) != 0 ) {
+            new_table->entries[new_table->count++] = old_table->entries[i];
+        }
+    }
+    if ( new_table->count == old_table->count ) {
+        registry_write_unlock();
+        return ESP_ERR_NOT_FOUND;
+    }
+    atomic_store(&registry_current, 1-current);
+    // grace period: once the old table has no readers, the caller may release the command info
+    registry_wait_readers(old_table);
+    registry_write_unlock();
+
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif //CLI_DYNAMIC_COMMANDS_MAX>0
+}
@@ -0,0 +1,16 @@
+
+#ifndef CMD_REGISTRY_H__
+#define CMD_REGISTRY_H__
+
+#include "esp_system.h"
+
+#include "cmd_create.h"
+
+
+bool cli_registry_find(const char* name, int len, cli_funct_info_t* info);
+
+typedef bool (*cli_registry_cb_t)(const cli_funct_info_t* info, void* arg);
+void cli_registry_foreach(cli_registry_cb_t cb, void* arg);
+
+
+#endif //CMD_REGISTRY_H__
@@ -2,172 +2,848 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/semphr.h"
+#include "esp_log.h"
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "cmd_run.h"
 #include "cmd_create.h"
+#include "cmd_registry.h"
+#include "cli.h"
+#include "cli_stats.h"
+#include "cmd_coop.h"
+#include "cmd_placement.h"
 
-extern cli_funct_info_t __cli_commands_start[], __cli_commands_end[];
 
-struct async_params {
+#define CLI_CMD_TIMEOUT_MS CONFIG_CLI_CMD_TIMEOUT_MS
+
+#define CLI_CMD_POLL_MS 20
+
+#define CLI_CMD_CANCEL_GRACE_MS 100
+
+#define CLI_CMD_INPUT_SIZE 16
+
+#define CLI_CMD_SUCCEEDED(ret) ((ret) >= CLI_CMD_RETURN_OK)
+
+#if defined(CONFIG_CLI_COOP_ENABLED)
+#define CLI_COOP_ENABLED 1
+#else
+#define CLI_COOP_ENABLED 0
+#endif
+
+#if defined(CONFIG_CLI_STATIC_ALLOCATION)
+#define CLI_STATIC_ALLOCATION 1
+#define CLI_STATIC_CMD_TASKS CONFIG_CLI_STATIC_CMD_TASKS
+#define CLI_STATIC_CMD_STACK CONFIG_CLI_STATIC_CMD_STACK
+#else
+#define CLI_STATIC_ALLOCATION 0
+#endif
+
+#define CLI_MAX_LENGTH CONFIG_CLI_MAX_LEN
+
+#define CLI_CMD_MAX_STEPS 8
+
+// arguments are at least 1 character long and separated by at least 1 character
+#define CLI_CMD_MAX_SLOTS ((CLI_MAX_LENGTH+1)/2 + CLI_CMD_MAX_STEPS)
+
+
+enum cli_cmd_op_e {
+    CLI_CMD_OP_NONE = 0,
+    CLI_CMD_OP_SEQ,     // ;
+    CLI_CMD_OP_AND,     // &&
+    CLI_CMD_OP_OR,      // ||
+};
+
+struct cli_cmd_step_s {
+    cli_funct_info_t info;
+    int argc;
+    char** argv;
+    uint8_t op;  // operator before this step
+};
+
+
+/* Shared between the caller of cli_cmd_run() and the command task, freed by whoever
+   releases it last: a caller can give up waiting (timeout, Ctrl-C) while the command
+   is still running. */
+struct cli_cmd_ctx_s {
+    struct cli_cmd_ctx_s* next;
+    TaskHandle_t task;
     SemaphoreHandle_t sync;
-    int (*funct)(int, char**);
+    int refs;
     bool async;
-    char* cmd_str;
+    volatile bool cancelled;
+    volatile bool cancel_on_key;
+    volatile bool reads_input;
+    uint8_t input_pos;
+    uint8_t input_len;
+    uint8_t input[CLI_CMD_INPUT_SIZE];
+    bool (*poll)(bool);
     int return_val;
+    int timeout_ms;
+    int stack_size;
+    int priority;
+    int core;
+    int steps_count;
+    struct cli_cmd_step_s* steps;
+    char** argv;
+    char* command;
 };
+static struct cli_cmd_ctx_s* running_cmds = NULL;
+static struct cli_cmd_ctx_s* foreground_cmd = NULL;  // waited for by the CLI task, which hands it the input
+static portMUX_TYPE running_cmds_mux = portMUX_INITIALIZER_UNLOCKED;
+
 void cli_cmd_task(void* vparams);
 
-int cli_cmd_run(bool async, char* cmd_str) {
-    cli_funct_info_t* cmd_info;
-    int cmd_len=0;
+#if CLI_STATIC_ALLOCATION==1
+/* The contexts come from a fixed pool, a context is free when it is released */
+struct cli_cmd_buffs_s {
+    struct cli_cmd_ctx_s ctx;
+    struct cli_cmd_step_s steps[CLI_CMD_MAX_STEPS];
+    char* argv[CLI_CMD_MAX_SLOTS+1];
+    char command[CLI_MAX_LENGTH+1];
+    StaticSemaphore_t sync_buff;
+};
+static struct cli_cmd_buffs_s cmd_buffs[CLI_STATIC_CMD_TASKS];
 
-    while ( cmd_str[cmd_len] != ' '  &&  cmd_str[cmd_len] != '\0' ) {
-        cmd_len++;
-    }
+/* Commands run on a fixed pool of persistent tasks, created on first use. A free worker
+   is moved to another core by creating it again, on the same buffers. */
+struct cli_cmd_worker_s {
+    TaskHandle_t task;
+    struct cli_cmd_ctx_s* ctx;  // command to run
+    bool busy;
+    int core;
+    StaticTask_t task_buff;
+    StackType_t stack[CLI_STATIC_CMD_STACK];
+};
+static struct cli_cmd_worker_s cmd_workers[CLI_STATIC_CMD_TASKS];
 
-    if ( cmd_len == 0 ) {
-        return CLI_CMD_RETURN_OK;
+void cli_cmd_worker(void* vparams);
+#endif //CLI_STATIC_ALLOCATION==1
+
+
+static int cmd_operator(const char* str, int len, uint8_t* op) {
+    if ( str[0] == ';' ) {
+        *op = CLI_CMD_OP_SEQ;
+        return 1;
+    }
+    if ( len >= 2  &&  str[0] == '&'  &&  str[1] == '&' ) {
+        *op = CLI_CMD_OP_AND;
+        return 2;
     }
+    if ( len >= 2  &&  str[0] == '|'  &&  str[1] == '|' ) {
+        *op = CLI_CMD_OP_OR;
+        return 2;
+    }
+    return 0;
+}
 
-    for (cmd_info=__cli_commands_start ; cmd_info<__cli_commands_end ; cmd_info++) {
-        if ( strlen(cmd_info->name) != cmd_len ) {
+/* Splits the first len characters of the command into arguments separated by unquoted
+   spaces, copied to out. Quotes are removed and \" is kept as ". Unquoted ';', '&&' and
+   '||' separate commands: each one takes an argv slot set to NULL (ending the argv of
+   the previous command) and is stored as the op of the next step. With out set to
+   NULL, slots and operators are only counted. Returns the number of argv slots used. */
+static int cmd_tokenize(const char* src, int len, char* out, char** argv, struct cli_cmd_step_s* steps, int* ops_count) {
+    const char* end = src+len;
+    int slots = 0;
+    *ops_count = 0;
+    while (1) {
+        while ( src < end  &&  *src == ' ' ) {
+            src++;
+        }
+        if ( src >= end ) {
+            break;
+        }
+
+        uint8_t op;
+        int op_len = cmd_operator(src, end-src, &op);
+        if ( op_len > 0 ) {
+            if ( out != NULL ) {
+                argv[slots] = NULL;
+                steps[*ops_count+1].op = op;
+            }
+            slots++;
+            (*ops_count)++;
+            src += op_len;
             continue;
         }
-        if ( strncmp(cmd_str, cmd_info->name, cmd_len) == 0 ) {
-            struct async_params params;
-            params.cmd_str = cmd_str;
-            params.funct = cmd_info->funct;
-            params.async = async;
-            params.sync = xSemaphoreCreateBinary();
-            xTaskCreate( cli_cmd_task, cmd_str, cmd_info->stack_size, (void*)&params, cmd_info->priority, NULL );
-            if ( async ) {
-                int ret = xSemaphoreTake( params.sync, pdMS_TO_TICKS(100) );
-                if ( ret == pdFAIL ) {
-                    return CLI_CMD_RETURN_ASYNC_TIMEOUT;
-                }
-                else {
-                    return params.return_val;
-                }
+
+        if ( out != NULL ) {
+            argv[slots] = out;
+        }
+        slots++;
+
+        bool quoted = false;
+        while ( src < end ) {
+            if ( !quoted  &&  (*src == ' '  ||  cmd_operator(src, end-src, &op) > 0) ) {
+                break;
+            }
+            if ( *src == '\\'  &&  src+1 < end  &&  src[1] == '"' ) {
+                src++;
             }
-            else {
-                xSemaphoreTake( params.sync, portMAX_DELAY );
-                return params.return_val;
+            else if ( *src == '"' ) {
+                quoted = !quoted;
+                src++;
+                continue;
             }
+            if ( out != NULL ) {
+                *out++ = *src;
+            }
+            src++;
+        }
+        if ( out != NULL ) {
+            *out++ = '\0';
         }
     }
+    return slots;
+}
 
-    return CLI_CMD_RETURN_CMD_NOT_FOUND;
+
+/* Command context */
+#if CLI_STATIC_ALLOCATION==1
+static struct cli_cmd_ctx_s* cmd_ctx_alloc(int steps_count, int slots, int len) {
+    if ( steps_count > CLI_CMD_MAX_STEPS  ||  slots > CLI_CMD_MAX_SLOTS  ||  len > CLI_MAX_LENGTH ) {
+        return NULL;
+    }
+
+    // the context is cleared and claimed at once, so refs is never seen back at 0 once taken
+    struct cli_cmd_buffs_s* buffs = NULL;
+    portENTER_CRITICAL(&running_cmds_mux);
+    for (int i=0 ; i<CLI_STATIC_CMD_TASKS ; i++) {
+        if ( cmd_buffs[i].ctx.refs == 0 ) {
+            buffs = &cmd_buffs[i];
+            SemaphoreHandle_t sync = buffs->ctx.sync;
+            memset(&buffs->ctx, 0, sizeof(struct cli_cmd_ctx_s));
+            buffs->ctx.sync = sync;
+            buffs->ctx.refs = 1;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&running_cmds_mux);
+    if ( buffs == NULL ) {
+        return NULL;
+    }
+
+    struct cli_cmd_ctx_s* ctx = &buffs->ctx;
+    if ( ctx->sync == NULL ) {
+        ctx->sync = xSemaphoreCreateBinaryStatic(&buffs->sync_buff);
+    }
+    else {
+        xSemaphoreTake(ctx->sync, 0);  // left given by a command whose caller stopped waiting
+    }
+    ctx->steps = buffs->steps;
+    ctx->argv = buffs->argv;
+    ctx->command = buffs->command;
+    return ctx;
 }
 
-void cli_cmd_task(void* vparams) {
-    struct async_params* params = (struct async_params*)vparams;
-    int cmd_len = strlen(params->cmd_str);
-
-    char* command_name = NULL;
-    int argc = 0;
-    char** argv = NULL;
-
-    char* command = malloc(cmd_len+1);
-    if (command == NULL) {
-        params->return_val = CLI_CMD_RETURN_RUNTIME_ERROR;
-        xSemaphoreGive( params->sync );
-        goto exit;
-    }
-    strcpy(command, params->cmd_str);
-    command[cmd_len] = '\0';
-
-    if ( params->async ) {
-        for (int i=cmd_len-1 ; i>0 ; i--) {
-            if ( command[i] == '&' ) {
-                command[i] = '\0';
+static void cmd_ctx_free(struct cli_cmd_ctx_s* ctx) {
+    // the context is free again as soon as refs is 0
+}
+
+/* Prefers a free worker already on the core, then one that was never used, then a free
+   worker on another core, to be moved. A command never runs on another core. */
+static struct cli_cmd_worker_s* cmd_worker_reserve(int core) {
+    struct cli_cmd_worker_s* worker = NULL;
+    struct cli_cmd_worker_s* other_core = NULL;
+    portENTER_CRITICAL(&running_cmds_mux);
+    for (int i=0 ; i<CLI_STATIC_CMD_TASKS ; i++) {
+        struct cli_cmd_worker_s* it = &cmd_workers[i];
+        if ( it->busy ) {
+            continue;
+        }
+        if ( it->task != NULL  &&  (core == tskNO_AFFINITY  ||  it->core == core) ) {
+            worker = it;
+            break;
+        }
+        if ( it->task == NULL  &&  worker == NULL ) {
+            worker = it;
+        }
+        if ( it->task != NULL  &&  other_core == NULL ) {
+            other_core = it;
+        }
+    }
+    if ( worker == NULL ) {
+        worker = other_core;
+    }
+    if ( worker != NULL ) {
+        worker->busy = true;
+    }
+    portEXIT_CRITICAL(&running_cmds_mux);
+    return worker;
+}
+
+/* The worker is deleted once it is blocked waiting for its next command (it may still be
+   finishing the previous one), so its buffers are not in use anymore */
+static void cmd_worker_delete(struct cli_cmd_worker_s* worker) {
+    eTaskState state;
+    while ( (state = eTaskGetState(worker->task)) != eBlocked  &&  state != eSuspended ) {
+        vTaskDelay(1);
+    }
+    vTaskDelete(worker->task);
+    worker->task = NULL;
+}
+
+static bool cmd_ctx_start(struct cli_cmd_ctx_s* ctx, int core) {
+    struct cli_cmd_worker_s* worker = cmd_worker_reserve(core);
+    if ( worker == NULL ) {
+        return false;
+    }
+    if ( worker->task != NULL  &&  worker->core != core  &&  core != tskNO_AFFINITY ) {
+        ESP_LOGD("CLI", "Moving a command task to core %d for '%s'", core, ctx->steps[0].info.name);
+        cmd_worker_delete(worker);
+    }
+    if ( worker->task == NULL ) {
+        worker->core = core;
+        worker->task = xTaskCreateStaticPinnedToCore( cli_cmd_worker, "cli_cmd", CLI_STATIC_CMD_STACK, (void*)worker, ctx->priority, worker->stack, &worker->task_buff, core );
+        if ( worker->task == NULL ) {
+            portENTER_CRITICAL(&running_cmds_mux);
+            worker->busy = false;
+            portEXIT_CRITICAL(&running_cmds_mux);
+            return false;
+        }
+    }
+    else {
+        vTaskPrioritySet( worker->task, ctx->priority );
+    }
+    portENTER_CRITICAL(&running_cmds_mux);
+    worker->ctx = ctx;
+    portEXIT_CRITICAL(&running_cmds_mux);
+    xTaskNotifyGive( worker->task );
+    return true;
+}
+#else
+static struct cli_cmd_ctx_s* cmd_ctx_alloc(int steps_count, int slots, int len) {
+    struct cli_cmd_ctx_s* ctx = malloc(sizeof(struct cli_cmd_ctx_s) + steps_count*sizeof(struct cli_cmd_step_s) + (slots+1)*sizeof(char*) + len+1);
+    if ( ctx == NULL ) {
+        return NULL;
+    }
+    memset(ctx, 0, sizeof(struct cli_cmd_ctx_s));
+    ctx->sync = xSemaphoreCreateBinary();
+    if ( ctx->sync == NULL ) {
+        free(ctx);
+        return NULL;
+    }
+    ctx->refs = 1;
+    ctx->steps = (struct cli_cmd_step_s*)(ctx+1);
+    ctx->argv = (char**)(ctx->steps+steps_count);
+    ctx->command = (char*)(ctx->argv+slots+1);
+    return ctx;
+}
+
+static void cmd_ctx_free(struct cli_cmd_ctx_s* ctx) {
+    vSemaphoreDelete(ctx->sync);
+    free(ctx);
+}
+
+static bool cmd_ctx_start(struct cli_cmd_ctx_s* ctx, int core) {
+    return xTaskCreatePinnedToCore( cli_cmd_task, ctx->steps[0].info.name, ctx->stack_size, (void*)ctx, ctx->priority, NULL, core ) == pdPASS;
+}
+#endif //CLI_STATIC_ALLOCATION==1
+
+static void cmd_ctx_parse(struct cli_cmd_ctx_s* ctx, const char* cmd_str, int len, int slots, int ops_count);
+
+static struct cli_cmd_ctx_s* cmd_ctx_create(const char* cmd_str, bool async) {
+    int len = strlen(cmd_str);
+    if ( async ) {  // drop the trailing '&', not the end of a '&&'
+        for (int i=len-1 ; i>0 ; i--) {
+            if ( cmd_str[i] == '&' ) {
+                if ( cmd_str[i-1] != '&' ) {
+                    len = i;
+                }
                 break;
             }
-            else if ( command[i] != ' ' ) {
+            else if ( cmd_str[i] != ' ' ) {
                 break;
             }
         }
     }
 
-    // count non-successive unquoted spaces
-    bool ignore_space = false;
-    for (int i=0 ; i<cmd_len ; i++) {
-        if ( i > 0 ) {
-            if ( command[i] == '"'  &&  command[i-1] != '\\' ) {
-                ignore_space = !ignore_space;
-                command[i] = '\0';
-            }
+    int ops_count;
+    int slots = cmd_tokenize(cmd_str, len, NULL, NULL, NULL, &ops_count);
+    int steps_count = ops_count+1;
+
+    struct cli_cmd_ctx_s* ctx = cmd_ctx_alloc(steps_count, slots, len);
+    if ( ctx == NULL ) {
+        return NULL;
+    }
+    cmd_ctx_parse(ctx, cmd_str, len, slots, ops_count);
+    ctx->async = async;
+    return ctx;
+}
+
+/* Tokenizes the command into the buffers of the context, and splits it into steps */
+static void cmd_ctx_parse(struct cli_cmd_ctx_s* ctx, const char* cmd_str, int len, int slots, int ops_count) {
+    int steps_count = ops_count+1;
+    cmd_tokenize(cmd_str, len, ctx->command, ctx->argv, ctx->steps, &ops_count);
+    ctx->steps[0].op = CLI_CMD_OP_NONE;
+    ctx->argv[slots] = NULL;
+
+    // split argv into steps, one per command
+    int slot = 0;
+    for (int i=0 ; i<steps_count ; i++) {
+        struct cli_cmd_step_s* step = &ctx->steps[i];
+        step->argv = &ctx->argv[slot];
+        step->argc = 0;
+        while ( ctx->argv[slot] != NULL ) {
+            step->argc++;
+            slot++;
         }
-        if ( !ignore_space ) {
-            if ( command[i] == ' ' ) {
-                if ( command[i+1] != ' '  &&  command[i+1] != '\0' ) {
-                    argc++;
-                }
-                command[i] = '\0';
-            }
+        slot++;
+    }
+    ctx->steps_count = steps_count;
+    if ( steps_count > 1  &&  ctx->steps[steps_count-1].argc == 0  &&  ctx->steps[steps_count-1].op == CLI_CMD_OP_SEQ ) {
+        ctx->steps_count--;  // trailing ';', while an empty step after '&&' or '||' is rejected
+    }
+}
+
+/* Finds the commands of all steps, and the resources needed to run the whole chain */
+static int cmd_ctx_resolve(struct cli_cmd_ctx_s* ctx) {
+    ctx->timeout_ms = 0;
+    ctx->stack_size = 0;
+    ctx->priority = 0;
+    ctx->core = CLI_CMD_CORE_DEFAULT;
+    bool deadline = true;
+    for (int i=0 ; i<ctx->steps_count ; i++) {
+        struct cli_cmd_step_s* step = &ctx->steps[i];
+        if ( step->argc == 0 ) {  // such as nothing after '&&' or '||'
+            return CLI_CMD_RETURN_RUNTIME_ERROR;
+        }
+        if ( !cli_registry_find(step->argv[0], strlen(step->argv[0]), &step->info) ) {
+            return CLI_CMD_RETURN_CMD_NOT_FOUND;
         }
+        if ( step->info.stack_size > ctx->stack_size ) {
+            ctx->stack_size = step->info.stack_size;
+        }
+        if ( step->info.priority > ctx->priority ) {
+            ctx->priority = step->info.priority;
+        }
+        if ( ctx->core == CLI_CMD_CORE_DEFAULT ) {
+            ctx->core = step->info.core;
+        }
+        int timeout_ms = step->info.timeout_ms == CLI_CMD_TIMEOUT_DEFAULT ? CLI_CMD_TIMEOUT_MS : step->info.timeout_ms;
+        if ( timeout_ms <= 0 ) {
+            deadline = false;
+        }
+        ctx->timeout_ms += timeout_ms;
     }
-    argc++;
-    argv = malloc(argc*sizeof(char*));
-    if (argv == NULL) {
-        params->return_val = CLI_CMD_RETURN_RUNTIME_ERROR;
-        xSemaphoreGive( params->sync );
-        goto exit;
+    if ( !deadline ) {
+        ctx->timeout_ms = 0;
     }
+    return CLI_CMD_RETURN_OK;
+}
 
-    int cpy_offset = 0;
-    int elem_cnt = 0;
-    int arg_cnt = 0;
-    for (int i=0 ; i<cmd_len+1 ; i++) {
-        if ( command[i] == '\0' ) {
-            if ( command_name == NULL ) {
-                command_name = command+i-elem_cnt;
-                argv[arg_cnt++] = command_name;
+static int cmd_funct_call(struct cli_cmd_ctx_s* ctx, const cli_funct_info_t* info, int argc, char** argv) {
+#if CLI_COOP_ENABLED==1
+    if ( info->coop_funct != NULL ) {
+        // only the CLI task (which polls) and the command tasks are notified by the CLI
+        bool notified = ctx != NULL  &&  (ctx->poll != NULL  ||  ctx->task == xTaskGetCurrentTaskHandle());
+        return cli_coop_run(info, argc, argv, ctx != NULL ? ctx->poll : NULL, ctx != NULL ? &ctx->cancelled : NULL, notified);
+    }
+#endif //CLI_COOP_ENABLED==1
+    return info->funct(argc, argv);
+}
+
+/* Runs all steps in the calling context, with shell-like short-circuit evaluation */
+static int cmd_ctx_run_steps(struct cli_cmd_ctx_s* ctx) {
+    int ret = CLI_CMD_RETURN_OK;
+    for (int i=0 ; i<ctx->steps_count ; i++) {
+        struct cli_cmd_step_s* step = &ctx->steps[i];
+        if ( step->op == CLI_CMD_OP_AND  &&  !CLI_CMD_SUCCEEDED(ret) ) {
+            continue;
+        }
+        if ( step->op == CLI_CMD_OP_OR  &&  CLI_CMD_SUCCEEDED(ret) ) {
+            continue;
+        }
+        if ( ctx->cancelled ) {
+            return CLI_CMD_RETURN_CANCELLED;
+        }
+        ret = cmd_funct_call(ctx, &step->info, step->argc, step->argv);
+    }
+    return ret;
+}
+
+static void cmd_ctx_release(struct cli_cmd_ctx_s* ctx) {
+    portENTER_CRITICAL(&running_cmds_mux);
+    int refs = --ctx->refs;
+    portEXIT_CRITICAL(&running_cmds_mux);
+    if ( refs == 0 ) {
+        cmd_ctx_free(ctx);
+    }
+}
+
+static void cmd_ctx_cancel(struct cli_cmd_ctx_s* ctx) {
+    portENTER_CRITICAL(&running_cmds_mux);
+    ctx->cancelled = true;
+    if ( ctx->task != NULL ) {
+        xTaskNotifyGive(ctx->task);
+    }
+    portEXIT_CRITICAL(&running_cmds_mux);
+}
+
+static struct cli_cmd_ctx_s* cmd_ctx_current(void) {
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    struct cli_cmd_ctx_s* ctx;
+    portENTER_CRITICAL(&running_cmds_mux);
+    for (ctx=running_cmds ; ctx!=NULL ; ctx=ctx->next) {
+        if ( ctx->task == task ) {
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&running_cmds_mux);
+    return ctx;
+}
+
+static int cmd_ctx_wait_poll(struct cli_cmd_ctx_s* ctx, bool (*poll)(bool)) {
+    int timeout_ms = ctx->timeout_ms;
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+
+    while (1) {
+        TickType_t wait = poll != NULL ? pdMS_TO_TICKS(CLI_CMD_POLL_MS) : portMAX_DELAY;
+        if ( timeout_ms > 0 ) {
+            TickType_t elapsed = xTaskGetTickCount() - start;
+            if ( elapsed >= timeout ) {
+                cmd_ctx_cancel(ctx);
+                return CLI_CMD_RETURN_TIMEOUT;
             }
-            else if ( elem_cnt > 0  &&  argc > arg_cnt ) {
-                argv[arg_cnt++] = command+i-elem_cnt;
+            if ( timeout-elapsed < wait ) {
+                wait = timeout-elapsed;
             }
-            elem_cnt = 0;
-            cpy_offset = 0;
         }
-        else {
-            elem_cnt++;
-            if ( command[i+cpy_offset] == '\\'  &&  command[i+cpy_offset+1] == '"' ) {
-                cpy_offset++;
+        if ( xSemaphoreTake( ctx->sync, wait ) == pdTRUE ) {
+            return ctx->return_val;
+        }
+        if ( poll != NULL  &&  poll(ctx->cancel_on_key) ) {
+            // the command may not check for cancellation, so it is only given a short time to finish
+            cmd_ctx_cancel(ctx);
+            if ( xSemaphoreTake( ctx->sync, pdMS_TO_TICKS(CLI_CMD_CANCEL_GRACE_MS) ) == pdTRUE ) {
+                return ctx->return_val;
             }
-            command[i] = command[i+cpy_offset];
+            return CLI_CMD_RETURN_CANCELLED;
+        }
+    }
+}
+
+static int cmd_ctx_wait(struct cli_cmd_ctx_s* ctx, bool (*poll)(bool)) {
+    if ( poll == NULL ) {
+        return cmd_ctx_wait_poll(ctx, poll);
+    }
+    portENTER_CRITICAL(&running_cmds_mux);
+    foreground_cmd = ctx;
+    portEXIT_CRITICAL(&running_cmds_mux);
+    int ret = cmd_ctx_wait_poll(ctx, poll);
+    portENTER_CRITICAL(&running_cmds_mux);
+    foreground_cmd = NULL;
+    portEXIT_CRITICAL(&running_cmds_mux);
+    return ret;
+}
+
+
+/* Command run */
+#if CLI_COOP_ENABLED==1
+/* Chains made only of cooperative commands run on the caller (the CLI task from the
+   command line), a single one in the background becomes a job of the CLI task */
+static bool cmd_ctx_cooperative(struct cli_cmd_ctx_s* ctx) {
+    if ( ctx->async  &&  ctx->steps_count > 1 ) {
+        return false;
+    }
+    for (int i=0 ; i<ctx->steps_count ; i++) {
+        if ( ctx->steps[i].info.coop_funct == NULL ) {
+            return false;
+        }
+    }
+    return true;
+}
+#endif //CLI_COOP_ENABLED==1
+
+static int cmd_stats_count(int ret) {
+    CLI_STATS_ADD(commands_run, 1);
+    if ( !CLI_CMD_SUCCEEDED(ret) ) {
+        CLI_STATS_ADD(commands_failed, 1);
+    }
+    switch (ret) {
+        case CLI_CMD_RETURN_CMD_NOT_FOUND: CLI_STATS_ADD(commands_not_found, 1); break;
+        case CLI_CMD_RETURN_ASYNC_TIMEOUT: CLI_STATS_ADD(commands_async_timeout, 1); break;
+        case CLI_CMD_RETURN_TIMEOUT: CLI_STATS_ADD(commands_timeout, 1); break;
+        case CLI_CMD_RETURN_CANCELLED: CLI_STATS_ADD(commands_cancelled, 1); break;
+        default: break;
+    }
+    return ret;
+}
+
+int cli_cmd_run_poll(bool async, char* cmd_str, bool (*poll)(bool)) {
+    struct cli_cmd_ctx_s* ctx = cmd_ctx_create(cmd_str, async);
+    if ( ctx == NULL ) {
+        return cmd_stats_count(CLI_CMD_RETURN_RUNTIME_ERROR);
+    }
+    if ( ctx->steps_count == 1  &&  ctx->steps[0].argc == 0 ) {
+        cmd_ctx_release(ctx);
+        return CLI_CMD_RETURN_OK;
+    }
+    int ret = cmd_ctx_resolve(ctx);
+    if ( ret != CLI_CMD_RETURN_OK ) {
+        cmd_ctx_release(ctx);
+        return cmd_stats_count(ret);
+    }
+
+#if CLI_COOP_ENABLED==1
+    if ( cmd_ctx_cooperative(ctx) ) {
+        if ( async ) {
+            ret = cli_coop_start(&ctx->steps[0].info, ctx->steps[0].argc, ctx->steps[0].argv);
+        }
+        else {
+            ctx->poll = poll;
+            ret = cmd_ctx_run_steps(ctx);
         }
+        cmd_ctx_release(ctx);
+        return cmd_stats_count(ret);
+    }
+#endif //CLI_COOP_ENABLED==1
+
+    ctx->refs++;  // reference held by the command task
+    if ( !cmd_ctx_start(ctx, cli_placement_core(ctx->core)) ) {
+        ctx->refs--;
+        cmd_ctx_release(ctx);
+        return cmd_stats_count(CLI_CMD_RETURN_RUNTIME_ERROR);
+    }
+
+    if ( async ) {
+        if ( xSemaphoreTake( ctx->sync, pdMS_TO_TICKS(100) ) == pdFAIL ) {
+            ret = CLI_CMD_RETURN_ASYNC_TIMEOUT;
+        }
+        else {
+            ret = ctx->return_val;
+        }
+    }
+    else {
+        ret = cmd_ctx_wait(ctx, poll);
+    }
+    cmd_ctx_release(ctx);
+    return cmd_stats_count(ret);
+}
+
+int cli_cmd_run(bool async, char* cmd_str) {
+    return cli_cmd_run_poll(async, cmd_str, NULL);
+}
+
+/* Runs a command found in the registry on the calling task */
+int cli_cmd_exec(const cli_funct_info_t* info, int argc, char** argv) {
+    return cmd_funct_call(cmd_ctx_current(), info, argc, argv);
+}
+
+/* Runs the command on the caller's task and stack, without any allocation. Only
+   commands created with CLI_CMD_FLAG_IN_CALLER can be run this way. The buffers have
+   a fixed size, so the stack needed does not depend on the command line, and a line
+   longer than a line of the CLI fails. */
+int cli_cmd_call(const char* cmd_str, char* out, size_t out_size) {
+    if ( out_size > 0 ) {
+        out[0] = '\0';
+    }
+    int len = strlen(cmd_str);
+    if ( len > CLI_MAX_LENGTH ) {
+        return cmd_stats_count(CLI_CMD_RETURN_RUNTIME_ERROR);
     }
+    int ops_count;
+    int slots = cmd_tokenize(cmd_str, len, NULL, NULL, NULL, &ops_count);
+    if ( ops_count+1 > CLI_CMD_MAX_STEPS  ||  slots > CLI_CMD_MAX_SLOTS ) {
+        return cmd_stats_count(CLI_CMD_RETURN_RUNTIME_ERROR);
+    }
+
+    struct cli_cmd_ctx_s ctx;
+    struct cli_cmd_step_s steps[CLI_CMD_MAX_STEPS];
+    char* argv[CLI_CMD_MAX_SLOTS+1];
+    char command[CLI_MAX_LENGTH+1];
+    memset(&ctx, 0, sizeof(struct cli_cmd_ctx_s));
+    ctx.steps = steps;
+    ctx.argv = argv;
+    ctx.command = command;
+    cmd_ctx_parse(&ctx, cmd_str, len, slots, ops_count);
 
-    if ( command_name == NULL ) {
-        params->return_val = CLI_CMD_RETURN_RUNTIME_ERROR;
-        xSemaphoreGive( params->sync );
-        goto exit;
+    if ( ctx.steps_count == 1  &&  ctx.steps[0].argc == 0 ) {
+        return CLI_CMD_RETURN_OK;
+    }
+    int ret = cmd_ctx_resolve(&ctx);
+    if ( ret != CLI_CMD_RETURN_OK ) {
+        return cmd_stats_count(ret);
+    }
+    for (int i=0 ; i<ctx.steps_count ; i++) {
+        if ( (ctx.steps[i].info.flags & CLI_CMD_FLAG_IN_CALLER) == 0 ) {
+            return cmd_stats_count(CLI_CMD_RETURN_NOT_IN_CALLER);
+        }
     }
 
-    if ( params->async ) {
-        params->return_val = CLI_CMD_RETURN_OK;
-        xSemaphoreGive( params->sync );
+    // the output is dropped when no buffer is given
+    cli_capture_t capture;
+    cli_capture_begin(&capture, out, out_size);
+    ret = cmd_ctx_run_steps(&ctx);
+    cli_capture_end(&capture);
+    return cmd_stats_count(ret);
+}
+
+static void cmd_ctx_execute(struct cli_cmd_ctx_s* ctx) {
+    portENTER_CRITICAL(&running_cmds_mux);
+    ctx->task = xTaskGetCurrentTaskHandle();
+    ctx->next = running_cmds;
+    running_cmds = ctx;
+    portEXIT_CRITICAL(&running_cmds_mux);
+
+    if ( ctx->async ) {
+        ctx->return_val = CLI_CMD_RETURN_OK;
+        xSemaphoreGive( ctx->sync );
     }
 
-    int ret = params->funct(argc, argv);
+    int ret = cmd_ctx_run_steps(ctx);
 
-    if ( !params->async ) {
-        params->return_val = ret;
-        xSemaphoreGive( params->sync );
+    if ( !ctx->async ) {
+        ctx->return_val = ret;
+        xSemaphoreGive( ctx->sync );
     }
 
-exit:
-    if (command != NULL) {
-        free(command);
+    portENTER_CRITICAL(&running_cmds_mux);
+    for (struct cli_cmd_ctx_s** it=&running_cmds ; *it!=NULL ; it=&(*it)->next) {
+        if ( *it == ctx ) {
+            *it = ctx->next;
+            break;
+        }
     }
-    if (argv != NULL) {
-        free(argv);
+    ctx->task = NULL;
+    portEXIT_CRITICAL(&running_cmds_mux);
+}
+
+#if CLI_STATIC_ALLOCATION==1
+void cli_cmd_worker(void* vparams) {
+    struct cli_cmd_worker_s* worker = (struct cli_cmd_worker_s*)vparams;
+    while (1) {
+        ulTaskNotifyTake( pdTRUE, portMAX_DELAY );  // also woken by cancellations
+        portENTER_CRITICAL(&running_cmds_mux);
+        struct cli_cmd_ctx_s* ctx = worker->ctx;
+        worker->ctx = NULL;
+        portEXIT_CRITICAL(&running_cmds_mux);
+        if ( ctx != NULL ) {
+            cmd_ctx_execute(ctx);
+            portENTER_CRITICAL(&running_cmds_mux);
+            worker->busy = false;
+            portEXIT_CRITICAL(&running_cmds_mux);
+            cmd_ctx_release(ctx);
+        }
     }
+}
+#endif //CLI_STATIC_ALLOCATION==1
+
+void cli_cmd_task(void* vparams) {
+    struct cli_cmd_ctx_s* ctx = (struct cli_cmd_ctx_s*)vparams;
+    cmd_ctx_execute(ctx);
+    cmd_ctx_release(ctx);
 
     vTaskDelete(NULL);
     while (1) {
         vTaskDelay(1000);
     }
 }
+
+
+/* Cancellation, from inside a command */
+bool cli_cmd_cancelled(void) {
+    struct cli_cmd_ctx_s* ctx = cmd_ctx_current();
+    return ctx != NULL  &&  ctx->cancelled;
+}
+
+static bool cmd_ctx_sleep(struct cli_cmd_ctx_s* ctx, TickType_t duration) {
+    if ( ctx == NULL ) {
+        vTaskDelay( duration );
+        return true;
+    }
+
+    TickType_t start = xTaskGetTickCount();
+    while ( !ctx->cancelled ) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if ( elapsed >= duration ) {
+            return true;
+        }
+        ulTaskNotifyTake( pdTRUE, duration-elapsed );
+    }
+    return false;
+}
+
+bool cli_cmd_sleep_ms(uint32_t ms) {
+    return cmd_ctx_sleep(cmd_ctx_current(), pdMS_TO_TICKS(ms));
+}
+
+/* After an overrun, the missed periods are skipped: the schedule keeps its phase */
+bool cli_cmd_sleep_until(TickType_t* last_wake, uint32_t period_ms) {
+    struct cli_cmd_ctx_s* ctx = cmd_ctx_current();
+    TickType_t now = xTaskGetTickCount();
+    TickType_t period = pdMS_TO_TICKS(period_ms) > 0 ? pdMS_TO_TICKS(period_ms) : 1;
+    *last_wake += period;
+    if ( (int32_t)(*last_wake - now) <= 0 ) {
+        *last_wake += ((now - *last_wake) / period + 1) * period;
+    }
+    return cmd_ctx_sleep(ctx, *last_wake - now);
+}
+
+void cli_cmd_cancel_on_key(bool enabled) {
+    struct cli_cmd_ctx_s* ctx = cmd_ctx_current();
+    if ( ctx != NULL ) {
+        ctx->cancel_on_key = enabled;
+    }
+}
+
+
+/* Input: only the CLI task reads the console. While it waits for a foreground command
+   that asked for input, it hands the bytes over instead of keeping them. */
+int cli_cmd_input_room(void) {
+    int room = -1;
+    portENTER_CRITICAL(&running_cmds_mux);
+    if ( foreground_cmd != NULL  &&  foreground_cmd->reads_input ) {
+        room = CLI_CMD_INPUT_SIZE - foreground_cmd->input_len;
+    }
+    portEXIT_CRITICAL(&running_cmds_mux);
+    return room;
+}
+
+bool cli_cmd_input(uint8_t val) {
+    bool taken = false;
+    portENTER_CRITICAL(&running_cmds_mux);
+    struct cli_cmd_ctx_s* ctx = foreground_cmd;
+    if ( ctx != NULL  &&  ctx->reads_input  &&  ctx->input_len < CLI_CMD_INPUT_SIZE ) {
+        ctx->input[(ctx->input_pos + ctx->input_len++) % CLI_CMD_INPUT_SIZE] = val;
+        if ( ctx->task != NULL ) {
+            xTaskNotifyGive(ctx->task);
+        }
+        taken = true;
+    }
+    portEXIT_CRITICAL(&running_cmds_mux);
+    return taken;
+}
+
+int cli_cmd_getchar(uint32_t timeout_ms) {
+    struct cli_cmd_ctx_s* ctx = cmd_ctx_current();
+    if ( ctx == NULL ) {
+        return EOF;
+    }
+    ctx->reads_input = true;
+
+    TickType_t start = xTaskGetTickCount();
+    TickType_t timeout = pdMS_TO_TICKS(timeout_ms);
+    while ( !ctx->cancelled ) {
+        int in = EOF;
+        portENTER_CRITICAL(&running_cmds_mux);
+        if ( ctx->input_len > 0 ) {
+            in = ctx->input[ctx->input_pos];
+            ctx->input_pos = (ctx->input_pos + 1) % CLI_CMD_INPUT_SIZE;
+            ctx->input_len--;
+        }
+        portEXIT_CRITICAL(&running_cmds_mux);
+        if ( in != EOF ) {
+            return in;
+        }
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        if ( elapsed >= timeout ) {
+            break;
+        }
+        ulTaskNotifyTake( pdTRUE, timeout-elapsed );  // woken by the input and by cancellation
+    }
+    return EOF;
+}
@@ -5,10 +5,19 @@
 
 #include "esp_system.h"
 
+#include "cmd_create.h"
+
 int cli_cmd_run(bool async, char* cmd_str);
+int cli_cmd_run_poll(bool async, char* cmd_str, bool (*poll)(bool any_key));
+int cli_cmd_call(const char* cmd_str, char* out, size_t out_size);
+int cli_cmd_exec(const cli_funct_info_t* info, int argc, char** argv);
+
+int cli_cmd_input_room(void);
+bool cli_cmd_input(uint8_t val);
 
 #define CLI_RUN(cmd) cli_cmd_run(false, cmd)
 #define CLI_RUN_ASYNC(cmd) cli_cmd_run(true, cmd)
+#define CLI_CALL(cmd, out, out_size) cli_cmd_call(cmd, out, out_size)
 
 
 #endif //CMD_RUN_H__
@@ -0,0 +1,282 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_USE_CMD_BENCH)
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cmd_create.h"
+#include "../cmd_run.h"
+#include "../cli.h"
+#include "../cli_bench.h"
+
+#if defined(ESP_PLATFORM)
+#include "esp_heap_caps.h"
+#endif
+
+
+#define BENCH_COPY_SIZE 4096
+
+#define BENCH_NOP_COMMAND "bench_nop"
+
+#if defined(CONFIG_CLI_DYNAMIC_COMMANDS_MAX)
+#define BENCH_DYNAMIC_COMMANDS_MAX CONFIG_CLI_DYNAMIC_COMMANDS_MAX
+#else
+#define BENCH_DYNAMIC_COMMANDS_MAX 0
+#endif
+
+#if defined(CONFIG_CLI_CMD_CORE_POLICY_OFF_PROTOCOL)
+#define BENCH_CORE (1-CONFIG_CLI_CMD_PROTOCOL_CORE)
+#else
+#define BENCH_CORE (portNUM_PROCESSORS-1)
+#endif
+
+
+/* Memory regions */
+enum bench_region_e {
+    BENCH_REGION_DRAM = 0,  // internal RAM
+    BENCH_REGION_PSRAM,     // external RAM
+};
+
+#define BENCH_REGIONS(src, dst) (((src) << 8) | (dst))
+
+static void* bench_region_alloc(enum bench_region_e region, size_t size) {
+#if defined(ESP_PLATFORM)
+    uint32_t caps = region == BENCH_REGION_PSRAM ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL;
+    return heap_caps_malloc(size, caps | MALLOC_CAP_8BIT);
+#else
+    // the host only has one kind of memory
+    return region == BENCH_REGION_DRAM ? malloc(size) : NULL;
+#endif
+}
+
+static void bench_region_free(void* buff) {
+#if defined(ESP_PLATFORM)
+    heap_caps_free(buff);
+#else
+    free(buff);
+#endif
+}
+
+
+/* memcpy and memset, across the memory regions */
+struct bench_buffs_s {
+    uint8_t* src;
+    uint8_t* dst;
+};
+static struct bench_buffs_s bench_buffs;
+
+static bool bench_buffs_setup(cli_bench_t* bench) {
+    bench_buffs.src = bench_region_alloc(bench->info->param >> 8, BENCH_COPY_SIZE);
+    bench_buffs.dst = bench_region_alloc(bench->info->param & 0xff, BENCH_COPY_SIZE);
+    if ( bench_buffs.src == NULL  ||  bench_buffs.dst == NULL ) {
+        bench_region_free(bench_buffs.src);
+        bench_region_free(bench_buffs.dst);
+        return false;
+    }
+    memset(bench_buffs.src, 0x5a, BENCH_COPY_SIZE);
+    bench->data = &bench_buffs;
+    return true;
+}
+
+static void bench_buffs_teardown(cli_bench_t* bench) {
+    bench_region_free(bench_buffs.src);
+    bench_region_free(bench_buffs.dst);
+}
+
+static void bench_memcpy(cli_bench_t* bench, uint32_t iterations) {
+    struct bench_buffs_s* buffs = bench->data;
+    for (uint32_t i=0 ; i<iterations ; i++) {
+        memcpy(buffs->dst, buffs->src, BENCH_COPY_SIZE);
+        CLI_BENCH_KEEP(buffs->dst);
+    }
+}
+
+static void bench_memset(cli_bench_t* bench, uint32_t iterations) {
+    struct bench_buffs_s* buffs = bench->data;
+    for (uint32_t i=0 ; i<iterations ; i++) {
+        memset(buffs->dst, i, BENCH_COPY_SIZE);
+        CLI_BENCH_KEEP(buffs->dst);
+    }
+}
+
+#define BENCH_COPY(bench_name, bench_funct, src, dst)  \
+            CLI_BENCH_DECLARE(bench_name, .setup = bench_buffs_setup, .teardown = bench_buffs_teardown,  \
+                              .param = BENCH_REGIONS(src, dst), .bytes = BENCH_COPY_SIZE) {  \
+                bench_funct(bench, iterations);  \
+            }
+
+BENCH_COPY(memcpy_dram, bench_memcpy, BENCH_REGION_DRAM, BENCH_REGION_DRAM)
+BENCH_COPY(memcpy_psram, bench_memcpy, BENCH_REGION_PSRAM, BENCH_REGION_PSRAM)
+BENCH_COPY(memcpy_dram_psram, bench_memcpy, BENCH_REGION_DRAM, BENCH_REGION_PSRAM)
+BENCH_COPY(memcpy_psram_dram, bench_memcpy, BENCH_REGION_PSRAM, BENCH_REGION_DRAM)
+BENCH_COPY(memset_dram, bench_memset, BENCH_REGION_DRAM, BENCH_REGION_DRAM)
+BENCH_COPY(memset_psram, bench_memset, BENCH_REGION_PSRAM, BENCH_REGION_PSRAM)
+
+
+/* Heap, a block allocated and freed right away */
+static void bench_malloc_free(cli_bench_t* bench, uint32_t iterations) {
+    size_t size = bench->info->param;
+    for (uint32_t i=0 ; i<iterations ; i++) {
+        void* block = malloc(size);
+        CLI_BENCH_KEEP(block);
+        free(block);
+    }
+}
+
+CLI_BENCH_DECLARE(malloc_free_32, .param = 32) {
+    bench_malloc_free(bench, iterations);
+}
+
+CLI_BENCH_DECLARE(malloc_free_256, .param = 256) {
+    bench_malloc_free(bench, iterations);
+}
+
+CLI_BENCH_DECLARE(malloc_free_4096, .param = 4096) {
+    bench_malloc_free(bench, iterations);
+}
+
+
+/* CLI dispatch of a command that does nothing, registered for the benchmark only. The
+   benchmarks are skipped when commands cannot be registered at runtime. */
+#if BENCH_DYNAMIC_COMMANDS_MAX>0
+static int bench_nop(int argc, char** argv) {
+    return CLI_CMD_RETURN_OK;
+}
+
+static const cli_funct_info_t bench_nop_info = {
+    .name = BENCH_NOP_COMMAND,
+    .stack_size = 2048,
+    .priority = 10,
+    .funct = bench_nop,
+    .flags = CLI_CMD_FLAG_IN_CALLER,
+};
+#endif //BENCH_DYNAMIC_COMMANDS_MAX>0
+
+static bool bench_dispatch_setup(cli_bench_t* bench) {
+#if BENCH_DYNAMIC_COMMANDS_MAX>0
+    return cli_register_command(&bench_nop_info) == ESP_OK;
+#else
+    return false;
+#endif //BENCH_DYNAMIC_COMMANDS_MAX>0
+}
+
+static void bench_dispatch_teardown(cli_bench_t* bench) {
+    cli_unregister_command(BENCH_NOP_COMMAND);
+}
+
+// parsing, lookup and run on the caller's task
+CLI_BENCH_DECLARE(dispatch_call, .setup = bench_dispatch_setup, .teardown = bench_dispatch_teardown) {
+    for (uint32_t i=0 ; i<iterations ; i++) {
+        CLI_CALL(BENCH_NOP_COMMAND, NULL, 0);
+    }
+}
+
+// the same, run on a command task
+CLI_BENCH_DECLARE(dispatch_task, .setup = bench_dispatch_setup, .teardown = bench_dispatch_teardown) {
+    char command[] = BENCH_NOP_COMMAND;
+    for (uint32_t i=0 ; i<iterations ; i++) {
+        cli_cmd_run(false, command);
+    }
+}
+
+
+/* Command */
+struct bench_cmd_s {
+    int argc;
+    char** argv;
+    const cli_bench_opts_t* opts;
+    int count;
+};
+
+static bool bench_matches(const cli_bench_info_t* info, int argc, char** argv) {
+    for (int i=1 ; i<argc ; i++) {
+        if ( argv[i][0] == '-' ) {
+            i++;  // option value
+            continue;
+        }
+        if ( strcmp(argv[i], "all") == 0  ||  strncmp(info->name, argv[i], strlen(argv[i])) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool bench_list(const cli_bench_info_t* info, void* arg) {
+    cli_printf("  %s\n", info->name);
+    return true;
+}
+
+static bool bench_run(const cli_bench_info_t* info, void* arg) {
+    struct bench_cmd_s* cmd = arg;
+    if ( !bench_matches(info, cmd->argc, cmd->argv) ) {
+        return true;
+    }
+    if ( cmd->count++ == 0 ) {
+        cli_printf("%-20s %10s %10s %10s %10s %10s\n", "benchmark", "iterations", "min", "median", "p99", "MB/s");
+    }
+
+    cli_bench_result_t result;
+    esp_err_t err = cli_bench_run(info, cmd->opts, &result);
+    if ( err == ESP_ERR_NOT_SUPPORTED ) {
+        cli_printf("%-20s skipped\n", info->name);
+        return true;
+    }
+    if ( err != ESP_OK ) {
+        cli_printf("%-20s failed (0x%x)\n", info->name, err);
+        return !CLI_CMD_CANCELLED();
+    }
+
+    cli_printf("%-20s %10u %10u %10u %10u", info->name, result.iterations, result.min, result.median, result.p99);
+    if ( info->bytes > 0  &&  result.median > 0 ) {
+        // bytes per us is MB/s
+        cli_printf(" %10u", (uint32_t)((uint64_t)info->bytes * CLI_BENCH_CYCLES_PER_US() / result.median));
+    }
+    cli_printf("\n");
+    return !CLI_CMD_CANCELLED();
+}
+
+static void bench_usage(void) {
+    cli_printf("  Usage:  bench                     list the benchmarks\n");
+    cli_printf("          bench <prefix>|all ... [-n samples] [-w warmup] [-t sample_us]\n");
+}
+
+// pinned, as the cycle counter is per core: off the protocol core when the commands are
+// kept off it, else on the last core
+CLI_CMD_DECLARE(bench, 4096, 10, .timeout_ms = CLI_CMD_TIMEOUT_NONE, .core = CLI_CMD_CORE_PINNED(BENCH_CORE)) {
+    if ( argc == 1 ) {
+        cli_bench_foreach(bench_list, NULL);
+        return CLI_CMD_RETURN_OK;
+    }
+
+    cli_bench_opts_t opts = CLI_BENCH_OPTS_DEFAULT();
+    opts.cancelled = cli_cmd_cancelled;
+    if ( CMD_HAS_ARG("-n") ) {
+        opts.samples = atoi(CMD_ARG_VALUE("-n"));
+    }
+    if ( CMD_HAS_ARG("-w") ) {
+        opts.warmup = atoi(CMD_ARG_VALUE("-w"));
+    }
+    if ( CMD_HAS_ARG("-t") ) {
+        opts.sample_us = atoi(CMD_ARG_VALUE("-t"));
+    }
+    if ( opts.samples == 0  ||  opts.samples > CLI_BENCH_MAX_SAMPLES  ||  opts.sample_us == 0  ||  opts.sample_us > CLI_BENCH_MAX_SAMPLE_US ) {
+        bench_usage();
+        return CLI_CMD_RETURN_ARG_ERROR;
+    }
+
+    struct bench_cmd_s cmd = { .argc = argc, .argv = argv, .opts = &opts, .count = 0 };
+    cli_bench_foreach(bench_run, &cmd);
+    if ( CLI_CMD_CANCELLED() ) {
+        return CLI_CMD_RETURN_CANCELLED;
+    }
+    if ( cmd.count == 0 ) {
+        cli_printf("No benchmark matches\n");
+        return CLI_CMD_RETURN_ARG_ERROR;
+    }
+    return CLI_CMD_RETURN_OK;
+}
+
+#endif
@@ -0,0 +1,37 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_USE_CMD_JOBS)
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../cmd_create.h"
+#include "../cli.h"
+#include "../cmd_coop.h"
+
+
+static bool jobs_print(int id, const char* name, void* arg) {
+    cli_printf("[%d] %s\n", id, name);
+    return true;
+}
+
+CLI_CMD(jobs) {
+    if ( CMD_HAS_ARG("-k") ) {
+        const char* id = CMD_ARG_VALUE("-k");
+        if ( strlen(id) == 0 ) {
+            cli_printf("  Usage:  jobs [-k <id>]\n");
+            return CLI_CMD_RETURN_ARG_ERROR;
+        }
+        if ( cli_coop_cancel(atoi(id)) != ESP_OK ) {
+            cli_printf("No job %s\n", id);
+            return CLI_CMD_RETURN_ERROR;
+        }
+        return CLI_CMD_RETURN_OK;
+    }
+
+    cli_coop_foreach(jobs_print, NULL);
+    return CLI_CMD_RETURN_OK;
+}
+
+#endif
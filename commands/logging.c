@@ -0,0 +1,60 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_USE_CMD_LOG)
+
+#include <string.h>
+
+#include "../cmd_create.h"
+#include "../cli.h"
+#include "../log_buffer.h"
+
+
+static int parse_log_level(const char* str, esp_log_level_t* level) {
+    switch (str[0]) {
+        case 'e': case 'E': *level = ESP_LOG_ERROR; break;
+        case 'w': case 'W': *level = ESP_LOG_WARN; break;
+        case 'i': case 'I': *level = ESP_LOG_INFO; break;
+        case 'd': case 'D': *level = ESP_LOG_DEBUG; break;
+        case 'v': case 'V': *level = ESP_LOG_VERBOSE; break;
+        default: return -1;
+    }
+    return 0;
+}
+
+CLI_CMD_STACK(dmesg, 3072) {
+    if ( CMD_HAS_ARG("-D") ) {
+        log_buffer_set_console(false);
+        return CLI_CMD_RETURN_OK;
+    }
+    if ( CMD_HAS_ARG("-E") ) {
+        log_buffer_set_console(true);
+        return CLI_CMD_RETURN_OK;
+    }
+
+    esp_log_level_t level = ESP_LOG_VERBOSE;
+    const char* tag = NULL;
+    if ( CMD_HAS_ARG("-l") ) {
+        if ( parse_log_level(CMD_ARG_VALUE("-l"), &level) != 0 ) {
+            cli_printf("  Usage:  dmesg [-l <level>] [-t <tag>] [-c] [-D|-E]\n");
+            return CLI_CMD_RETURN_ARG_ERROR;
+        }
+    }
+    if ( CMD_HAS_ARG("-t") ) {
+        tag = CMD_ARG_VALUE("-t");
+        if ( strlen(tag) == 0 ) {
+            cli_printf("  Usage:  dmesg [-l <level>] [-t <tag>] [-c] [-D|-E]\n");
+            return CLI_CMD_RETURN_ARG_ERROR;
+        }
+    }
+
+    log_buffer_dump(level, tag);
+
+    if ( CMD_HAS_ARG("-c") ) {
+        log_buffer_clear();
+    }
+
+    return CLI_CMD_RETURN_OK;
+}
+
+#endif
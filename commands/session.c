@@ -0,0 +1,58 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_USE_CMD_SESSION)
+
+#include <stdio.h>
+#include <string.h>
+
+#include "../cmd_create.h"
+#include "../cli.h"
+#include "../session.h"
+
+
+static void session_usage(void) {
+    cli_printf("  Usage:  session record <file>\n");
+    cli_printf("          session stop\n");
+    cli_printf("          session replay <file> [-f] [-q]\n");
+}
+
+CLI_CMD_STACK(session, 3072) {
+    if ( argc == 3  &&  strcmp(argv[1], "record") == 0 ) {
+        FILE* file = fopen(argv[2], "wb");
+        if ( file == NULL ) {
+            cli_printf("Cannot open '%s'\n", argv[2]);
+            return CLI_CMD_RETURN_ERROR;
+        }
+        if ( session_record_start(file) != ESP_OK ) {
+            fclose(file);
+            cli_printf("A session is already recorded or replayed\n");
+            return CLI_CMD_RETURN_ERROR;
+        }
+        return CLI_CMD_RETURN_OK;
+    }
+
+    if ( argc == 2  &&  strcmp(argv[1], "stop") == 0 ) {
+        FILE* file = session_record_stop();
+        if ( file == NULL ) {
+            cli_printf("No session is recorded\n");
+            return CLI_CMD_RETURN_ERROR;
+        }
+        fclose(file);
+        return CLI_CMD_RETURN_OK;
+    }
+
+    if ( argc >= 3  &&  strcmp(argv[1], "replay") == 0 ) {
+        // -f: as fast as possible instead of real time, -q: count the output without printing it
+        if ( session_replay_request(argv[2], !CMD_HAS_ARG("-f"), CMD_HAS_ARG("-q")) != ESP_OK ) {
+            cli_printf("Cannot replay '%s' now\n", argv[2]);
+            return CLI_CMD_RETURN_ERROR;
+        }
+        return CLI_CMD_RETURN_OK;
+    }
+
+    session_usage();
+    return CLI_CMD_RETURN_ARG_ERROR;
+}
+
+#endif
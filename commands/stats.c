@@ -0,0 +1,38 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_USE_CMD_STATS)
+
+#include <string.h>
+
+#include "../cmd_create.h"
+#include "../cli.h"
+#include "../cli_stats.h"
+
+
+#define CLISTATS_JSON_MAX 384
+
+
+CLI_CMD_IN_CALLER(clistats) {
+    cli_stats_t stats;
+    cli_stats_get(&stats);
+
+    if ( CMD_HAS_ARG("--json") ) {
+        char json[CLISTATS_JSON_MAX];
+        cli_stats_json(&stats, json, sizeof(json));
+        cli_printf("%s\n", json);
+    }
+    else {
+#define CLISTATS_PRINT(name) cli_printf("%-24s %u\n", #name, (unsigned)stats.name);
+        CLI_STATS_FIELDS(CLISTATS_PRINT)
+#undef CLISTATS_PRINT
+    }
+
+    if ( CMD_HAS_ARG("-r") ) {
+        cli_stats_reset();
+    }
+
+    return CLI_CMD_RETURN_OK;
+}
+
+#endif
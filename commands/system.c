@@ -8,9 +8,10 @@
 
 #include "../cmd_create.h"
 #include "../cli.h"
+#include "../cmd_registry.h"
 
 
-CLI_CMD(sizeof) {
+CLI_CMD_IN_CALLER(sizeof) {
     if ( argc < 2 ) {
         cli_printf("  Usage:  sizeof <type> ...\n");
         return CLI_CMD_RETURN_ARG_ERROR;
@@ -47,7 +48,7 @@ CLI_CMD(restart) {
     return CLI_CMD_RETURN_OK;
 }
 
-CLI_CMD(version) {
+CLI_CMD_IN_CALLER(version) {
     cli_printf("ESP-IDF %s\n", esp_get_idf_version());
 
     esp_chip_info_t chip_info;
@@ -74,30 +75,33 @@ CLI_CMD(sleep) {
     }
 
     int duration = atoi(argv[1]);
-    CLI_CMD_SLEEP(duration);
+    if ( !CLI_CMD_SLEEP(duration) ) {
+        return CLI_CMD_RETURN_CANCELLED;
+    }
 
     return CLI_CMD_RETURN_OK;
 }
 
-CLI_CMD(heap) {
+CLI_CMD_IN_CALLER(heap) {
     cli_printf("Free heap size: %d bytes\n", esp_get_free_heap_size());
 
     return CLI_CMD_RETURN_OK;
 }
 
-CLI_CMD(heap_min) {
+CLI_CMD_IN_CALLER(heap_min) {
     cli_printf("Minimum free heap size: %d bytes\n", esp_get_minimum_free_heap_size());
 
     return CLI_CMD_RETURN_OK;
 }
 
-extern cli_funct_info_t __cli_commands_start[], __cli_commands_end[];
+static bool help_print(const cli_funct_info_t* cmd_info, void* arg) {
+    cli_printf("%s\n", cmd_info->name);
+    return true;
+}
+
 CLI_CMD(help) {
-    cli_funct_info_t* cmd_info;
     cli_printf("******** All available commands ********\n");
-    for (cmd_info=__cli_commands_start ; cmd_info<__cli_commands_end ; cmd_info++) {
-        cli_printf("%s\n", cmd_info->name);
-    }
+    cli_registry_foreach(help_print, NULL);
     cli_printf("********          END           ********\n");
 
     return CLI_CMD_RETURN_OK;
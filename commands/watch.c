@@ -0,0 +1,156 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_USE_CMD_WATCH)
+
+#include <string.h>
+#include <stdlib.h>
+
+#include "../cmd_create.h"
+#include "../cli.h"
+#include "../cmd_registry.h"
+#include "../cmd_run.h"
+
+
+#define WATCH_STACK 4096
+
+#define WATCH_OUTPUT_SIZE 1024
+
+#define WATCH_MIN_PERIOD_MS 10
+
+#if defined(CONFIG_CLI_ANSI_ESCAPE_CODE_ENABLED)
+#define WATCH_IN_PLACE 1
+#else
+#define WATCH_IN_PLACE 0
+#endif
+
+#if defined(CONFIG_CLI_STATIC_ALLOCATION)
+#define WATCH_STATIC_BUFFERS 1
+#else
+#define WATCH_STATIC_BUFFERS 0
+#endif
+
+
+#if WATCH_STATIC_BUFFERS==1
+// a single watch can run at a time
+static char watch_buffs[2*WATCH_OUTPUT_SIZE];
+static portMUX_TYPE watch_mux = portMUX_INITIALIZER_UNLOCKED;
+static bool watch_running = false;
+
+static char* watch_alloc(void) {
+    portENTER_CRITICAL(&watch_mux);
+    bool running = watch_running;
+    watch_running = true;
+    portEXIT_CRITICAL(&watch_mux);
+    return running ? NULL : watch_buffs;
+}
+
+static void watch_free(char* buffs) {
+    watch_running = false;
+}
+#else
+static char* watch_alloc(void) {
+    return malloc(2*WATCH_OUTPUT_SIZE);
+}
+
+static void watch_free(char* buffs) {
+    free(buffs);
+}
+#endif //WATCH_STATIC_BUFFERS==1
+
+
+/* Prints the output, highlighting the characters that differ from the previous one.
+   Returns the number of lines printed. */
+static int watch_render(const char* out, int len, const char* prev, int prev_len) {
+    int lines = 0;
+    const char* out_end = out+len;
+    const char* prev_end = prev+prev_len;
+    while ( out < out_end ) {
+        const char* eol = memchr(out, '\n', out_end-out);
+        int line_len = eol != NULL ? eol-out : out_end-out;
+        const char* prev_eol = prev < prev_end ? memchr(prev, '\n', prev_end-prev) : NULL;
+        int prev_line_len = prev < prev_end ? (prev_eol != NULL ? prev_eol-prev : prev_end-prev) : 0;
+
+        int start = 0;
+        bool changed = false;
+        for (int i=0 ; i<=line_len ; i++) {
+            bool diff = i < line_len  &&  WATCH_IN_PLACE  &&  prev_len > 0  &&  (i >= prev_line_len || out[i] != prev[i]);
+            if ( i == line_len  ||  diff != changed ) {
+                cli_printf("%s%.*s%s", changed ? "\033[7m" : "", i-start, out+start, changed ? "\033[0m" : "");
+                start = i;
+                changed = diff;
+            }
+        }
+        cli_printf(WATCH_IN_PLACE ? "\033[K\n" : "\n");
+        lines++;
+
+        out += line_len+1;
+        prev = prev_eol != NULL ? prev_eol+1 : prev_end;
+    }
+    return lines;
+}
+
+CLI_CMD_DECLARE(watch, WATCH_STACK, 10, .timeout_ms = CLI_CMD_TIMEOUT_NONE) {
+    int period_ms = 1000;
+    int cmd_idx = 1;
+    if ( argc > 2  &&  strcmp(argv[1], "-n") == 0 ) {
+        period_ms = atoi(argv[2]);
+        cmd_idx = 3;
+    }
+    if ( cmd_idx >= argc  ||  period_ms < WATCH_MIN_PERIOD_MS ) {
+        cli_printf("  Usage:  watch [-n <ms>] <command> [args...]\n");
+        return CLI_CMD_RETURN_ARG_ERROR;
+    }
+
+    // the watched command is looked up once and called directly on this task, with the same argv
+    cli_funct_info_t info;
+    if ( !cli_registry_find(argv[cmd_idx], strlen(argv[cmd_idx]), &info) ) {
+        cli_printf("Command not found\n");
+        return CLI_CMD_RETURN_CMD_NOT_FOUND;
+    }
+    if ( info.stack_size > WATCH_STACK/2 ) {
+        cli_printf("The command '%s' needs a larger stack than watch can provide\n", info.name);
+        return CLI_CMD_RETURN_ERROR;
+    }
+
+    char* buffs = watch_alloc();
+    if ( buffs == NULL ) {
+        return CLI_CMD_RETURN_RUNTIME_ERROR;
+    }
+    char* out = buffs;
+    char* prev = buffs+WATCH_OUTPUT_SIZE;
+    int prev_len = 0;
+    int lines = 0;
+
+    CLI_CMD_CANCEL_ON_KEY();
+    TickType_t last_wake = xTaskGetTickCount();
+    do {
+        cli_capture_t capture;
+        cli_capture_begin(&capture, out, WATCH_OUTPUT_SIZE);
+        cli_cmd_exec(&info, argc-cmd_idx, argv+cmd_idx);
+        int len = cli_capture_end(&capture);
+
+        if ( lines > 0  &&  WATCH_IN_PLACE ) {
+            cli_printf("\033[%dA\r", lines);
+        }
+        cli_printf("Every %dms:", period_ms);
+        for (int i=cmd_idx ; i<argc ; i++) {
+            cli_printf(" %s", argv[i]);
+        }
+        cli_printf(WATCH_IN_PLACE ? "\033[K\n" : "\n");
+        lines = 1 + watch_render(out, len, prev, prev_len);
+        if ( WATCH_IN_PLACE ) {
+            cli_printf("\033[J");
+        }
+
+        char* tmp = prev;
+        prev = out;
+        out = tmp;
+        prev_len = len;
+    } while ( CLI_CMD_MSSLEEP_UNTIL(&last_wake, period_ms) );
+
+    watch_free(buffs);
+    return CLI_CMD_RETURN_OK;
+}
+
+#endif
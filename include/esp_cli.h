@@ -13,4 +13,8 @@
 #include "../cmd_run.h"
 #endif
 
+#ifdef CONFIG_CLI_BENCH_ENABLED
+#include "../cli_bench.h"
+#endif
+
 #endif //ESP_CLI_H__
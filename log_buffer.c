@@ -0,0 +1,563 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_LOG_BUFFER_ENABLED)
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "log_buffer.h"
+#include "cli.h"
+
+
+#define LOG_BUFFER_SIZE CONFIG_CLI_LOG_BUFFER_SIZE
+
+#define LOG_BUFFER_MAX_STRING CONFIG_CLI_LOG_BUFFER_MAX_STRING
+
+#define LOG_BUFFER_PAYLOAD_MAX 128
+
+#define LOG_BUFFER_LINE_MAX 256
+
+#define LOG_BUFFER_NO_TAG 0xff
+
+
+/* A record is a header followed by the raw bytes of the arguments, in the order
+   they are consumed by the format string. Nothing is formatted until read back. */
+struct log_record_s {
+    const char* format;
+    uint32_t timestamp;
+    uint16_t length;
+    uint8_t level;
+    uint8_t tag_offset;
+};
+
+enum log_arg_e {
+    LOG_ARG_NONE,
+    LOG_ARG_INT,
+    LOG_ARG_LONG,
+    LOG_ARG_LLONG,
+    LOG_ARG_SIZE,
+    LOG_ARG_INTMAX,
+    LOG_ARG_PTRDIFF,
+    LOG_ARG_DOUBLE,
+    LOG_ARG_LDOUBLE,
+    LOG_ARG_PTR,
+    LOG_ARG_STR,
+    LOG_ARG_SKIP,
+    LOG_ARG_INVALID
+};
+
+struct log_spec_s {
+    const char* start;
+    const char* end;
+    bool width_star;
+    bool precision_star;
+    int precision;
+    enum log_arg_e arg;
+};
+
+static uint8_t log_ring[LOG_BUFFER_SIZE];
+struct log_buffer_status_s {
+    int head;
+    int tail;
+    int used;
+    uint32_t head_seq;
+    uint32_t tail_seq;
+    bool console;
+};
+static struct log_buffer_status_s log_buffer_status = { .console = true };
+static portMUX_TYPE log_buffer_mux = portMUX_INITIALIZER_UNLOCKED;
+
+
+/* Format string parsing */
+static const char* log_spec_parse(const char* p, struct log_spec_s* spec) {
+    spec->start = p++;
+    spec->width_star = false;
+    spec->precision_star = false;
+    spec->precision = -1;
+
+    while ( *p == '-'  ||  *p == '+'  ||  *p == ' '  ||  *p == '#'  ||  *p == '0' ) {
+        p++;
+    }
+    if ( *p == '*' ) {
+        spec->width_star = true;
+        p++;
+    }
+    else {
+        while ( '0' <= *p  &&  *p <= '9' ) {
+            p++;
+        }
+    }
+    if ( *p == '.' ) {
+        p++;
+        if ( *p == '*' ) {
+            spec->precision_star = true;
+            p++;
+        }
+        else {
+            spec->precision = 0;
+            while ( '0' <= *p  &&  *p <= '9' ) {
+                spec->precision = spec->precision*10 + (*p - '0');
+                p++;
+            }
+        }
+    }
+
+    int longs = 0;
+    char length = '\0';
+    while ( *p == 'h'  ||  *p == 'l'  ||  *p == 'L'  ||  *p == 'z'  ||  *p == 'j'  ||  *p == 't' ) {
+        if ( *p == 'l' ) {
+            longs++;
+        }
+        length = *p;
+        p++;
+    }
+
+    char conv = *p;
+    if ( conv != '\0' ) {
+        p++;
+    }
+    spec->end = p;
+
+    switch (conv) {
+        case 'd': case 'i': case 'u': case 'o': case 'x': case 'X': case 'c': {
+            if ( longs >= 2 ) {
+                spec->arg = LOG_ARG_LLONG;
+            }
+            else if ( longs == 1 ) {
+                spec->arg = LOG_ARG_LONG;
+            }
+            else if ( length == 'z' ) {
+                spec->arg = LOG_ARG_SIZE;
+            }
+            else if ( length == 'j' ) {
+                spec->arg = LOG_ARG_INTMAX;
+            }
+            else if ( length == 't' ) {
+                spec->arg = LOG_ARG_PTRDIFF;
+            }
+            else {
+                spec->arg = LOG_ARG_INT;
+            }
+        }
+        break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A': {
+            spec->arg = length == 'L' ? LOG_ARG_LDOUBLE : LOG_ARG_DOUBLE;
+        }
+        break;
+        case 's': {
+            spec->arg = LOG_ARG_STR;
+        }
+        break;
+        case 'p': {
+            spec->arg = LOG_ARG_PTR;
+        }
+        break;
+        case 'n': {
+            spec->arg = LOG_ARG_SKIP;
+        }
+        break;
+        case '%': {
+            spec->arg = LOG_ARG_NONE;
+        }
+        break;
+        default: {
+            spec->arg = LOG_ARG_INVALID;
+        }
+        break;
+    }
+    return p;
+}
+
+static uint8_t log_buffer_level(const char* format) {
+    // skip the color code added by ESP_LOG when colors are enabled
+    if ( format[0] == '\033' ) {
+        while ( *format != '\0'  &&  *format != 'm' ) {
+            format++;
+        }
+        if ( *format == 'm' ) {
+            format++;
+        }
+    }
+    if ( format[0] == '\0'  ||  format[1] != ' ' ) {
+        return ESP_LOG_NONE;
+    }
+    switch (format[0]) {
+        case 'E': return ESP_LOG_ERROR;
+        case 'W': return ESP_LOG_WARN;
+        case 'I': return ESP_LOG_INFO;
+        case 'D': return ESP_LOG_DEBUG;
+        case 'V': return ESP_LOG_VERBOSE;
+        default: return ESP_LOG_NONE;
+    }
+}
+
+
+/* Argument encoding (logging side) */
+#define LOG_PUT(value)  \
+            do {  \
+                if ( len+sizeof(value) > LOG_BUFFER_PAYLOAD_MAX ) {  \
+                    return len;  \
+                }  \
+                memcpy(buf+len, &(value), sizeof(value));  \
+                len += sizeof(value);  \
+            } while (0)
+
+static int log_buffer_encode(const char* format, va_list args, uint8_t* buf, uint8_t* tag_offset) {
+    int len = 0;
+    *tag_offset = LOG_BUFFER_NO_TAG;
+
+    const char* p = format;
+    while ( *p != '\0' ) {
+        if ( *p != '%' ) {
+            p++;
+            continue;
+        }
+        struct log_spec_s spec;
+        p = log_spec_parse(p, &spec);
+
+        if ( spec.width_star ) {
+            int width = va_arg(args, int);
+            LOG_PUT(width);
+        }
+        if ( spec.precision_star ) {
+            spec.precision = va_arg(args, int);
+            LOG_PUT(spec.precision);
+        }
+
+        switch (spec.arg) {
+            case LOG_ARG_INT: {
+                int value = va_arg(args, int);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_LONG: {
+                long value = va_arg(args, long);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_LLONG: {
+                long long value = va_arg(args, long long);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_SIZE: {
+                size_t value = va_arg(args, size_t);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_INTMAX: {
+                intmax_t value = va_arg(args, intmax_t);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_PTRDIFF: {
+                ptrdiff_t value = va_arg(args, ptrdiff_t);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_DOUBLE: {
+                double value = va_arg(args, double);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_LDOUBLE: {
+                long double value = va_arg(args, long double);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_PTR: {
+                void* value = va_arg(args, void*);
+                LOG_PUT(value);
+            }
+            break;
+            case LOG_ARG_STR: {
+                // strings may not outlive the call, so a truncated copy is kept
+                const char* str = va_arg(args, const char*);
+                if ( str == NULL ) {
+                    str = "(null)";
+                }
+                int str_len = strnlen(str, LOG_BUFFER_MAX_STRING-1);
+                if ( spec.precision >= 0  &&  spec.precision < str_len ) {
+                    str_len = spec.precision;
+                }
+                if ( len+str_len+1 > LOG_BUFFER_PAYLOAD_MAX ) {
+                    return len;
+                }
+                if ( *tag_offset == LOG_BUFFER_NO_TAG  &&  len < LOG_BUFFER_NO_TAG ) {
+                    *tag_offset = len;
+                }
+                memcpy(buf+len, str, str_len);
+                buf[len+str_len] = '\0';
+                len += str_len+1;
+            }
+            break;
+            case LOG_ARG_SKIP: {
+                (void)va_arg(args, void*);
+            }
+            break;
+            case LOG_ARG_NONE: {
+            }
+            break;
+            case LOG_ARG_INVALID: {
+                return len;
+            }
+        }
+    }
+
+    return len;
+}
+
+
+/* Argument decoding (read back side) */
+#define LOG_GET(var)  \
+            do {  \
+                if ( pos+sizeof(var) > length ) {  \
+                    goto truncated;  \
+                }  \
+                memcpy(&(var), payload+pos, sizeof(var));  \
+                pos += sizeof(var);  \
+            } while (0)
+
+#define LOG_SNPRINTF(var)  \
+            do {  \
+                LOG_GET(var);  \
+                n = snprintf(line+out, size-out, spec_str, var);  \
+            } while (0)
+
+static void log_buffer_format(const char* format, const uint8_t* payload, int length, char* line, int size) {
+    int out = 0;
+    int pos = 0;
+
+    const char* p = format;
+    while ( *p != '\0'  &&  out < size-1 ) {
+        if ( *p != '%' ) {
+            line[out++] = *p++;
+            continue;
+        }
+        struct log_spec_s spec;
+        p = log_spec_parse(p, &spec);
+        if ( spec.arg == LOG_ARG_INVALID ) {
+            break;
+        }
+        if ( spec.arg == LOG_ARG_NONE ) {
+            line[out++] = '%';
+            continue;
+        }
+
+        // rebuild the conversion specification, with '*' replaced by the recorded values
+        char spec_str[32];
+        int spec_len = 0;
+        for (const char* c=spec.start ; c<spec.end && spec_len<(int)sizeof(spec_str)-12 ; c++) {
+            if ( *c == '*' ) {
+                int value;
+                LOG_GET(value);
+                spec_len += sprintf(spec_str+spec_len, "%d", value);
+            }
+            else {
+                spec_str[spec_len++] = *c;
+            }
+        }
+        spec_str[spec_len] = '\0';
+
+        int n = 0;
+        switch (spec.arg) {
+            case LOG_ARG_INT: {
+                int value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_LONG: {
+                long value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_LLONG: {
+                long long value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_SIZE: {
+                size_t value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_INTMAX: {
+                intmax_t value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_PTRDIFF: {
+                ptrdiff_t value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_DOUBLE: {
+                double value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_LDOUBLE: {
+                long double value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_PTR: {
+                void* value;
+                LOG_SNPRINTF(value);
+            }
+            break;
+            case LOG_ARG_STR: {
+                const uint8_t* end = pos < length ? memchr(payload+pos, '\0', length-pos) : NULL;
+                if ( end == NULL ) {
+                    goto truncated;
+                }
+                n = snprintf(line+out, size-out, spec_str, (const char*)(payload+pos));
+                pos = end-payload+1;
+            }
+            break;
+            default: {
+            }
+            break;
+        }
+        if ( n > 0 ) {
+            out += n;
+        }
+        if ( out > size-1 ) {
+            out = size-1;
+        }
+    }
+    goto done;
+
+truncated:
+    out += snprintf(line+out, size-out, " [truncated]\n");
+    if ( out > size-1 ) {
+        out = size-1;
+    }
+
+done:
+    line[out] = '\0';
+    if ( out > 0  &&  line[out-1] != '\n' ) {
+        if ( out == size-1 ) {
+            out--;
+        }
+        line[out++] = '\n';
+        line[out] = '\0';
+    }
+}
+
+
+/* Ring buffer */
+static void log_ring_write(int pos, const void* data, int len) {
+    int first = len < LOG_BUFFER_SIZE-pos ? len : LOG_BUFFER_SIZE-pos;
+    memcpy(log_ring+pos, data, first);
+    memcpy(log_ring, (const uint8_t*)data+first, len-first);
+}
+
+static void log_ring_read(int pos, void* data, int len) {
+    int first = len < LOG_BUFFER_SIZE-pos ? len : LOG_BUFFER_SIZE-pos;
+    memcpy(data, log_ring+pos, first);
+    memcpy((uint8_t*)data+first, log_ring, len-first);
+}
+
+void log_buffer_record(const char* format, va_list args) {
+    uint8_t payload[LOG_BUFFER_PAYLOAD_MAX];
+    struct log_record_s record;
+    record.format = format;
+    record.timestamp = esp_log_timestamp();
+    record.level = log_buffer_level(format);
+    record.length = log_buffer_encode(format, args, payload, &record.tag_offset);
+
+    int total = sizeof(record) + record.length;
+    if ( total > LOG_BUFFER_SIZE ) {
+        return;
+    }
+
+    portENTER_CRITICAL(&log_buffer_mux);
+    while ( log_buffer_status.used + total > LOG_BUFFER_SIZE ) {  // drop the oldest records
+        struct log_record_s oldest;
+        log_ring_read(log_buffer_status.tail, &oldest, sizeof(oldest));
+        int oldest_total = sizeof(oldest) + oldest.length;
+        log_buffer_status.tail = (log_buffer_status.tail + oldest_total) % LOG_BUFFER_SIZE;
+        log_buffer_status.used -= oldest_total;
+        log_buffer_status.tail_seq++;
+    }
+    log_ring_write(log_buffer_status.head, &record, sizeof(record));
+    log_ring_write((log_buffer_status.head + sizeof(record)) % LOG_BUFFER_SIZE, payload, record.length);
+    log_buffer_status.head = (log_buffer_status.head + total) % LOG_BUFFER_SIZE;
+    log_buffer_status.used += total;
+    log_buffer_status.head_seq++;
+    portEXIT_CRITICAL(&log_buffer_mux);
+}
+
+void log_buffer_dump(esp_log_level_t max_level, const char* tag) {
+    uint8_t payload[LOG_BUFFER_PAYLOAD_MAX];
+    char line[LOG_BUFFER_LINE_MAX];
+    struct log_record_s record;
+
+    portENTER_CRITICAL(&log_buffer_mux);
+    uint32_t seq = log_buffer_status.tail_seq;
+    int pos = log_buffer_status.tail;
+    portEXIT_CRITICAL(&log_buffer_mux);
+
+    while (1) {
+        // records are copied out one at a time, so logging is never blocked while printing
+        uint32_t lost = 0;
+        portENTER_CRITICAL(&log_buffer_mux);
+        if ( (int32_t)(seq - log_buffer_status.tail_seq) < 0 ) {
+            lost = log_buffer_status.tail_seq - seq;
+            seq = log_buffer_status.tail_seq;
+            pos = log_buffer_status.tail;
+        }
+        if ( seq == log_buffer_status.head_seq ) {
+            portEXIT_CRITICAL(&log_buffer_mux);
+            break;
+        }
+        log_ring_read(pos, &record, sizeof(record));
+        log_ring_read((pos + sizeof(record)) % LOG_BUFFER_SIZE, payload, record.length);
+        pos = (pos + sizeof(record) + record.length) % LOG_BUFFER_SIZE;
+        seq++;
+        portEXIT_CRITICAL(&log_buffer_mux);
+
+        if ( lost > 0 ) {
+            cli_printf("[%u records overwritten while reading]\n", lost);
+        }
+        if ( record.level == ESP_LOG_NONE ) {
+            if ( max_level != ESP_LOG_VERBOSE ) {
+                continue;
+            }
+        }
+        else if ( record.level > max_level ) {
+            continue;
+        }
+        if ( tag != NULL ) {
+            if ( record.tag_offset == LOG_BUFFER_NO_TAG  ||  strcmp((const char*)(payload+record.tag_offset), tag) != 0 ) {
+                continue;
+            }
+        }
+
+        log_buffer_format(record.format, payload, record.length, line, sizeof(line));
+        cli_printf("[%5u.%03u] %s", record.timestamp/1000, record.timestamp%1000, line);
+    }
+}
+
+void log_buffer_clear(void) {
+    portENTER_CRITICAL(&log_buffer_mux);
+    log_buffer_status.tail = log_buffer_status.head;
+    log_buffer_status.tail_seq = log_buffer_status.head_seq;
+    log_buffer_status.used = 0;
+    portEXIT_CRITICAL(&log_buffer_mux);
+}
+
+
+/* Console output of the log */
+void log_buffer_set_console(bool enabled) {
+    log_buffer_status.console = enabled;
+}
+
+bool log_buffer_console_enabled(void) {
+    return log_buffer_status.console;
+}
+
+#endif
@@ -0,0 +1,18 @@
+
+#ifndef LOG_BUFFER_H__
+#define LOG_BUFFER_H__
+
+#include "esp_system.h"
+#include "esp_log.h"
+
+
+void log_buffer_record(const char* format, va_list args);
+
+void log_buffer_dump(esp_log_level_t max_level, const char* tag);
+void log_buffer_clear(void);
+
+void log_buffer_set_console(bool enabled);
+bool log_buffer_console_enabled(void);
+
+
+#endif //LOG_BUFFER_H__
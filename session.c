@@ -0,0 +1,379 @@
+
+#include "sdkconfig.h"
+
+#if defined(CONFIG_CLI_SESSION_ENABLED)
+
+#include <stdio.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#include "session.h"
+#include "cli.h"
+
+
+#define SESSION_OUTPUT_MAX 256
+
+#define SESSION_PATH_MAX 64
+
+#if defined(CONFIG_CLI_STATIC_ALLOCATION)
+#define SESSION_STATIC_ALLOCATION 1
+#else
+#define SESSION_STATIC_ALLOCATION 0
+#endif
+
+
+/* A recording is the magic bytes followed by records. Each record starts with a varint
+   holding the time in ms since the previous record, shifted left by 2, and the record
+   type in the 2 low bits. */
+static const uint8_t session_magic[] = { 'C', 'L', 'I', 'S', SESSION_FORMAT_VERSION };
+
+enum session_record_e {
+    SESSION_RECORD_INPUT = 0,           // followed by the input byte
+    SESSION_RECORD_OUTPUT,              // followed by a varint length and the output bytes
+    SESSION_RECORD_OUTPUT_SKIPPED,      // followed by a varint length of output not stored
+    SESSION_RECORD_INPUT_POLLED,        // followed by the input byte, read while a command ran
+};
+
+struct session_status_s {
+    FILE* file;
+    int64_t start_us;
+    uint32_t last_ms;
+    SemaphoreHandle_t lock;
+    char output[SESSION_OUTPUT_MAX];
+    volatile bool replaying;
+    bool quiet;
+    FILE* replay_file;
+    bool replay_real_time;
+    int64_t replay_start_us;
+    uint32_t replay_time_ms;
+    uint32_t output_bytes;
+    volatile bool pending;
+    bool pending_real_time;
+    bool pending_quiet;
+    char pending_path[SESSION_PATH_MAX];
+};
+static struct session_status_s session_status;
+#if SESSION_STATIC_ALLOCATION==1
+static StaticSemaphore_t session_lock_buff;
+#endif //SESSION_STATIC_ALLOCATION==1
+
+void process_char(uint8_t val);
+int cli_typeahead_getchar(void);
+
+
+/* Recording */
+static void session_put_varint(uint32_t value) {
+    while ( value >= 0x80 ) {
+        fputc((value & 0x7f) | 0x80, session_status.file);
+        value >>= 7;
+    }
+    fputc(value, session_status.file);
+}
+
+static void session_put_record(enum session_record_e type) {
+    uint32_t now_ms = (esp_timer_get_time() - session_status.start_us) / 1000;
+    session_put_varint(((now_ms - session_status.last_ms) << 2) | type);
+    session_status.last_ms = now_ms;
+}
+
+esp_err_t session_record_start(FILE* file) {
+    if ( file == NULL ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( session_status.lock == NULL ) {
+#if SESSION_STATIC_ALLOCATION==1
+        session_status.lock = xSemaphoreCreateMutexStatic(&session_lock_buff);
+#else
+        session_status.lock = xSemaphoreCreateMutex();
+#endif //SESSION_STATIC_ALLOCATION==1
+        if ( session_status.lock == NULL ) {
+            return ESP_ERR_NO_MEM;
+        }
+    }
+
+    xSemaphoreTake(session_status.lock, portMAX_DELAY);
+    if ( session_status.file != NULL  ||  session_status.replaying ) {
+        xSemaphoreGive(session_status.lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    if ( fwrite(session_magic, 1, sizeof(session_magic), file) != sizeof(session_magic) ) {
+        xSemaphoreGive(session_status.lock);
+        return ESP_FAIL;
+    }
+    session_status.start_us = esp_timer_get_time();
+    session_status.last_ms = 0;
+    session_status.file = file;
+    xSemaphoreGive(session_status.lock);
+    return ESP_OK;
+}
+
+FILE* session_record_stop(void) {
+    if ( session_status.lock == NULL ) {
+        return NULL;
+    }
+    xSemaphoreTake(session_status.lock, portMAX_DELAY);
+    FILE* file = session_status.file;
+    session_status.file = NULL;
+    if ( file != NULL ) {
+        fflush(file);
+    }
+    xSemaphoreGive(session_status.lock);
+    return file;
+}
+
+void session_record_input(uint8_t val, bool polled) {
+    if ( session_status.file == NULL ) {
+        return;
+    }
+    xSemaphoreTake(session_status.lock, portMAX_DELAY);
+    if ( session_status.file != NULL ) {
+        session_put_record(polled ? SESSION_RECORD_INPUT_POLLED : SESSION_RECORD_INPUT);
+        fputc(val, session_status.file);
+    }
+    xSemaphoreGive(session_status.lock);
+}
+
+static void session_record_output(const char* format, va_list args) {
+    xSemaphoreTake(session_status.lock, portMAX_DELAY);
+    if ( session_status.file != NULL ) {
+        int len = vsnprintf(session_status.output, SESSION_OUTPUT_MAX, format, args);
+        int stored = len < SESSION_OUTPUT_MAX ? len : SESSION_OUTPUT_MAX-1;
+        if ( stored > 0 ) {
+            session_put_record(SESSION_RECORD_OUTPUT);
+            session_put_varint(stored);
+            fwrite(session_status.output, 1, stored, session_status.file);
+        }
+        if ( len > stored ) {
+            session_put_record(SESSION_RECORD_OUTPUT_SKIPPED);
+            session_put_varint(len-stored);
+        }
+    }
+    xSemaphoreGive(session_status.lock);
+}
+
+bool session_active(void) {
+    return session_status.file != NULL  ||  session_status.replaying;
+}
+
+bool session_replaying(void) {
+    return session_status.replaying;
+}
+
+/* Called for all the CLI output while a session is recorded or replayed */
+int session_print(vprintf_like_t print, const char* format, va_list args) {
+    int ret;
+    if ( session_status.replaying ) {
+        ret = session_status.quiet ? vsnprintf(NULL, 0, format, args) : print(format, args);
+        if ( ret > 0 ) {
+            session_status.output_bytes += ret;
+        }
+        return ret;
+    }
+
+    va_list record_args;
+    va_copy(record_args, args);
+    ret = print(format, args);
+    session_record_output(format, record_args);
+    va_end(record_args);
+    return ret;
+}
+
+
+/* Replay */
+static bool session_get_varint(FILE* file, uint32_t* value) {
+    *value = 0;
+    for (int shift=0 ; shift<32 ; shift+=7) {
+        int in = fgetc(file);
+        if ( in == EOF ) {
+            return false;
+        }
+        *value |= (uint32_t)(in & 0x7f) << shift;
+        if ( (in & 0x80) == 0 ) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void session_replay_char(uint8_t val, session_stats_t* stats) {
+    int64_t start = esp_timer_get_time();
+    process_char(val);
+    uint32_t elapsed = esp_timer_get_time() - start;
+
+    if ( val == '\n' ) {
+        stats->lines++;
+        stats->line_total_us += elapsed;
+        if ( elapsed > stats->line_max_us ) {
+            stats->line_max_us = elapsed;
+        }
+    }
+    else {
+        stats->keys++;
+        stats->key_total_us += elapsed;
+        if ( elapsed > stats->key_max_us ) {
+            stats->key_max_us = elapsed;
+        }
+    }
+}
+
+/* The input read while a command ran, and not taken by it, is processed once it
+   returns, as the CLI task does */
+static void session_replay_input(uint8_t val, session_stats_t* stats) {
+    session_replay_char(val, stats);
+    int in;
+    while ( (in = cli_typeahead_getchar()) != EOF ) {
+        session_replay_char(in, stats);
+    }
+}
+
+static int32_t session_replay_wait_ms(void) {
+    return session_status.replay_time_ms - (int32_t)((esp_timer_get_time() - session_status.replay_start_us) / 1000);
+}
+
+/* Called by the CLI while a replayed command runs: the next input byte, if it was read
+   while the command ran and its time has come, or EOF */
+int session_replay_polled_input(void) {
+    FILE* file = session_status.replay_file;
+    long pos = ftell(file);
+    uint32_t header;
+    if ( session_get_varint(file, &header)  &&  (header & 0x3) == SESSION_RECORD_INPUT_POLLED ) {
+        uint32_t time_ms = session_status.replay_time_ms;
+        session_status.replay_time_ms += header >> 2;
+        if ( !session_status.replay_real_time  ||  session_replay_wait_ms() <= 0 ) {
+            int in = fgetc(file);
+            if ( in != EOF ) {
+                return in;
+            }
+        }
+        session_status.replay_time_ms = time_ms;
+    }
+    fseek(file, pos, SEEK_SET);
+    return EOF;
+}
+
+/* Feeds the input of a recording to the CLI, from the task that processes the input */
+esp_err_t session_replay(FILE* file, bool real_time, bool quiet, session_stats_t* stats) {
+    memset(stats, 0, sizeof(session_stats_t));
+    uint8_t magic[sizeof(session_magic)];
+    // version 1 recordings have no polled input, and are replayed the same
+    if ( fread(magic, 1, sizeof(magic), file) != sizeof(magic)  ||  memcmp(magic, session_magic, sizeof(magic)-1) != 0
+         ||  magic[sizeof(magic)-1] < 1  ||  magic[sizeof(magic)-1] > SESSION_FORMAT_VERSION ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( session_status.file != NULL  ||  session_status.replaying ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    session_status.quiet = quiet;
+    session_status.output_bytes = 0;
+    session_status.replay_file = file;
+    session_status.replay_real_time = real_time;
+    session_status.replay_start_us = esp_timer_get_time();
+    session_status.replay_time_ms = 0;
+    session_status.replaying = true;
+
+    esp_err_t err = ESP_OK;
+    uint32_t header;
+    while ( session_get_varint(file, &header) ) {
+        session_status.replay_time_ms += header >> 2;
+        uint32_t len;
+        int in;
+        switch (header & 0x3) {
+            // input read while a command ran, once the command is over in the replay
+            case SESSION_RECORD_INPUT_POLLED:
+            case SESSION_RECORD_INPUT: {
+                if ( (in = fgetc(file)) == EOF ) {
+                    err = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+                if ( real_time ) {
+                    int32_t wait_ms = session_replay_wait_ms();
+                    if ( wait_ms > 0 ) {
+                        vTaskDelay(pdMS_TO_TICKS(wait_ms));
+                    }
+                }
+                session_replay_input(in, stats);
+            }
+            break;
+            case SESSION_RECORD_OUTPUT: {
+                if ( !session_get_varint(file, &len)  ||  fseek(file, len, SEEK_CUR) != 0 ) {
+                    err = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+                stats->recorded_output_bytes += len;
+            }
+            break;
+            case SESSION_RECORD_OUTPUT_SKIPPED: {
+                if ( !session_get_varint(file, &len) ) {
+                    err = ESP_ERR_INVALID_SIZE;
+                    break;
+                }
+                stats->recorded_output_bytes += len;
+            }
+            break;
+        }
+        if ( err != ESP_OK ) {
+            break;
+        }
+    }
+
+    session_status.replaying = false;
+    stats->output_bytes = session_status.output_bytes;
+    stats->duration_ms = (esp_timer_get_time() - session_status.replay_start_us) / 1000;
+    return err;
+}
+
+/* The replay requested by a command is run later by the CLI task, as commands run on
+   their own task while the CLI task waits for them */
+esp_err_t session_replay_request(const char* path, bool real_time, bool quiet) {
+    if ( strlen(path) >= SESSION_PATH_MAX ) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ( session_status.pending  ||  session_status.replaying  ||  session_status.file != NULL ) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    strcpy(session_status.pending_path, path);
+    session_status.pending_real_time = real_time;
+    session_status.pending_quiet = quiet;
+    session_status.pending = true;
+    return ESP_OK;
+}
+
+void session_replay_pending(void) {
+    if ( !session_status.pending ) {
+        return;
+    }
+    session_status.pending = false;
+
+    FILE* file = fopen(session_status.pending_path, "rb");
+    if ( file == NULL ) {
+        cli_printf("Cannot open '%s'\n", session_status.pending_path);
+        return;
+    }
+    session_stats_t stats;
+    esp_err_t err = session_replay(file, session_status.pending_real_time, session_status.pending_quiet, &stats);
+    fclose(file);
+    cli_printf("\n");
+    if ( err == ESP_ERR_INVALID_ARG ) {
+        cli_printf("'%s' is not a session recording\n", session_status.pending_path);
+        return;
+    }
+    if ( err != ESP_OK ) {
+        cli_printf("The recording is truncated\n");
+    }
+    session_print_stats(&stats);
+}
+
+void session_print_stats(const session_stats_t* stats) {
+    cli_printf("Replayed in %u ms\n", stats->duration_ms);
+    cli_printf("  Keys:   %u, avg %u us, max %u us\n", stats->keys,
+               stats->keys > 0 ? (uint32_t)(stats->key_total_us/stats->keys) : 0, stats->key_max_us);
+    cli_printf("  Lines:  %u, avg %u us, max %u us\n", stats->lines,
+               stats->lines > 0 ? (uint32_t)(stats->line_total_us/stats->lines) : 0, stats->line_max_us);
+    cli_printf("  Output: %u bytes (recorded: %u bytes)\n", stats->output_bytes, stats->recorded_output_bytes);
+}
+
+#endif //CONFIG_CLI_SESSION_ENABLED
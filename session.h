@@ -0,0 +1,41 @@
+#ifndef SESSION_H__
+#define SESSION_H__
+
+#include <stdio.h>
+#include "esp_system.h"
+#include "esp_err.h"
+#include "esp_log.h"
+
+
+#define SESSION_FORMAT_VERSION 2
+
+typedef struct {
+    uint32_t keys;                      // keystrokes processed, not counting new lines
+    uint32_t key_max_us;
+    uint64_t key_total_us;
+    uint32_t lines;                     // new lines processed, each one running a command line
+    uint32_t line_max_us;
+    uint64_t line_total_us;
+    uint32_t output_bytes;              // bytes printed by the CLI during the replay
+    uint32_t recorded_output_bytes;     // bytes printed by the CLI during the recording
+    uint32_t duration_ms;
+} session_stats_t;
+
+
+esp_err_t session_record_start(FILE* file);
+FILE* session_record_stop(void);
+void session_record_input(uint8_t val, bool polled);
+
+esp_err_t session_replay(FILE* file, bool real_time, bool quiet, session_stats_t* stats);
+esp_err_t session_replay_request(const char* path, bool real_time, bool quiet);
+void session_replay_pending(void);
+void session_print_stats(const session_stats_t* stats);
+
+int session_replay_polled_input(void);
+
+bool session_active(void);
+bool session_replaying(void);
+int session_print(vprintf_like_t print, const char* format, va_list args);
+
+
+#endif //SESSION_H__
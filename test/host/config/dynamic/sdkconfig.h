@@ -0,0 +1,25 @@
+/* Host tests: commands run on tasks created for each command */
+#define CONFIG_CLI_ENABLED 1
+#define CONFIG_CLI_TASK_NAME "cli"
+#define CONFIG_CLI_TASK_STACK 4096
+#define CONFIG_CLI_TASK_PRI 5
+#define CONFIG_CLI_ANSI_ESCAPE_CODE_ENABLED 1
+#define CONFIG_CLI_HISTORY_ENABLED 1
+#define CONFIG_CLI_HISTORY_LEN 8
+#define CONFIG_CLI_MAX_LEN 128
+#define CONFIG_CLI_CMD_TIMEOUT_MS 0
+#define CONFIG_CLI_CMD_CORE_POLICY_OFF_PROTOCOL 1
+#define CONFIG_CLI_CMD_PROTOCOL_CORE 0
+#define CONFIG_CLI_AUTOCOMPLETE_ENABLED 1
+#define CONFIG_CLI_ALLOW_COMMAND_ADDITION 1
+#define CONFIG_CLI_DYNAMIC_COMMANDS_MAX 8
+#define CONFIG_CLI_ALLOW_COMMAND_RUN 1
+#define CONFIG_CLI_COOP_ENABLED 1
+#define CONFIG_CLI_COOP_JOBS 4
+#define CONFIG_CLI_COOP_STATE_SIZE 64
+#define CONFIG_CLI_STATS_ENABLED 1
+#define CONFIG_CLI_USE_BUILTIN_COMMANDS 1
+#define CONFIG_CLI_USE_CMD_JOBS 1
+#define CONFIG_CLI_USE_CMD_STATS 1
+#define CONFIG_CLI_BENCH_ENABLED 1
+#define CONFIG_CLI_USE_CMD_BENCH 1
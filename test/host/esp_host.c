@@ -0,0 +1,126 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "host_test.h"
+
+
+/* Time */
+int64_t esp_timer_get_time(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec*1000000 + now.tv_nsec/1000;
+}
+
+
+/* Log */
+static vprintf_like_t host_log_vprintf = vprintf;
+static uint32_t host_logs = 0;
+
+vprintf_like_t esp_log_set_vprintf(vprintf_like_t func) {
+    vprintf_like_t previous = host_log_vprintf;
+    host_log_vprintf = func;
+    return previous;
+}
+
+uint32_t esp_log_timestamp(void) {
+    return esp_timer_get_time() / 1000;
+}
+
+void esp_log_write(esp_log_level_t level, const char* tag, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+    host_logs++;
+    host_log_vprintf(format, args);
+    va_end(args);
+}
+
+uint32_t host_log_count(void) {
+    return host_logs;
+}
+
+
+/* Console input: getchar() is wrapped, so tests control what the CLI reads. With the
+   optimizations on, glibc inlines getchar() as getc(stdin), which is wrapped too. */
+#define HOST_INPUT_SIZE 1024
+
+static char host_input_buff[HOST_INPUT_SIZE];
+static int host_input_pos = 0;
+static int host_input_len = 0;
+
+void host_input(const char* bytes) {
+    portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+    portENTER_CRITICAL(&mux);
+    int len = strlen(bytes);
+    memmove(host_input_buff, host_input_buff+host_input_pos, host_input_len-host_input_pos);
+    host_input_len -= host_input_pos;
+    host_input_pos = 0;
+    if ( host_input_len+len <= HOST_INPUT_SIZE ) {
+        memcpy(host_input_buff+host_input_len, bytes, len);
+        host_input_len += len;
+    }
+    portEXIT_CRITICAL(&mux);
+}
+
+int __real_getc(FILE* stream);
+
+int __wrap_getchar(void) {
+    return host_input_pos < host_input_len ? (unsigned char)host_input_buff[host_input_pos++] : EOF;
+}
+
+int __wrap_getc(FILE* stream) {
+    return stream == stdin ? __wrap_getchar() : __real_getc(stream);
+}
+
+
+/* Heap trap: malloc() and friends are wrapped */
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+void __real_free(void* ptr);
+
+static volatile bool host_heap_armed = false;
+static volatile uint32_t host_heap_count = 0;
+
+static void host_heap_call(const char* funct, size_t size, void* caller) {
+    if ( host_heap_armed ) {
+        host_heap_count++;
+        fprintf(stderr, "heap trap: %s(%zu) called from %p\n", funct, size, caller);
+    }
+}
+
+void* __wrap_malloc(size_t size) {
+    host_heap_call("malloc", size, __builtin_return_address(0));
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    host_heap_call("calloc", count*size, __builtin_return_address(0));
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size) {
+    host_heap_call("realloc", size, __builtin_return_address(0));
+    return __real_realloc(ptr, size);
+}
+
+void __wrap_free(void* ptr) {
+    if ( ptr != NULL ) {
+        host_heap_call("free", 0, __builtin_return_address(0));
+    }
+    __real_free(ptr);
+}
+
+void host_heap_trap(bool armed) {
+    host_heap_armed = armed;
+}
+
+uint32_t host_heap_calls(void) {
+    return host_heap_count;
+}
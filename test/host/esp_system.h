@@ -0,0 +1,12 @@
+#ifndef ESP_SYSTEM_H__
+#define ESP_SYSTEM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "sdkconfig.h"
+
+
+#endif //ESP_SYSTEM_H__
@@ -0,0 +1,10 @@
+#ifndef ESP_TIMER_H__
+#define ESP_TIMER_H__
+
+#include <stdint.h>
+
+
+int64_t esp_timer_get_time(void);
+
+
+#endif //ESP_TIMER_H__
@@ -0,0 +1,55 @@
+#ifndef FREERTOS_H__
+#define FREERTOS_H__
+
+/* The part of the FreeRTOS API used by the CLI, simulated on the host by freertos_host.c */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sdkconfig.h"
+
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint8_t StackType_t;
+typedef void (*TaskFunction_t)(void*);
+
+typedef struct host_task_s* TaskHandle_t;
+typedef struct {
+    int unused;                 // the simulation keeps its own task state
+} StaticTask_t;
+
+typedef struct {
+    UBaseType_t count;
+    UBaseType_t max;
+    bool dynamic;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t* SemaphoreHandle_t;
+
+typedef struct {
+    int unused;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED { 0 }
+
+#define configTICK_RATE_HZ 1000
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+#define portMAX_DELAY ((TickType_t)0xffffffff)
+#define portNUM_PROCESSORS 2
+
+#define pdFALSE 0
+#define pdTRUE 1
+#define pdFAIL pdFALSE
+#define pdPASS pdTRUE
+
+#define tskNO_AFFINITY 0x7fffffff
+
+void vPortEnterCritical(portMUX_TYPE* mux);
+void vPortExitCritical(portMUX_TYPE* mux);
+#define portENTER_CRITICAL(mux) vPortEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) vPortExitCritical(mux)
+
+
+#endif //FREERTOS_H__
@@ -0,0 +1,37 @@
+#ifndef TASK_H__
+#define TASK_H__
+
+#include "freertos/FreeRTOS.h"
+
+
+typedef enum {
+    eRunning = 0,
+    eReady,
+    eBlocked,
+    eSuspended,
+    eDeleted,
+    eInvalid
+} eTaskState;
+
+BaseType_t xTaskCreate(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, TaskHandle_t* handle);
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core);
+TaskHandle_t xTaskCreateStatic(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buff);
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buff, BaseType_t core);
+void vTaskDelete(TaskHandle_t task);
+eTaskState eTaskGetState(TaskHandle_t task);
+
+void vTaskDelay(TickType_t ticks);
+TickType_t xTaskGetTickCount(void);
+TaskHandle_t xTaskGetCurrentTaskHandle(void);
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority);
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task);
+BaseType_t xPortGetCoreID(void);
+
+void vPortYield(void);
+#define taskYIELD() vPortYield()
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks);
+
+
+#endif //TASK_H__
@@ -0,0 +1,484 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "host_test.h"
+
+
+/* A single core FreeRTOS scheduler simulated with threads: only the task holding the
+   core runs, and the core goes to the highest priority ready task, the one ready for
+   the longest among equal priorities. As on the target, a task gives up the core when
+   it blocks, and is preempted when a task of higher priority becomes ready, or at the
+   tick by a ready task of the same priority. A task running without calling FreeRTOS
+   is only preempted at its next call. A tick is 1 ms of real time. */
+
+#define HOST_MAX_TASKS 64
+
+#define HOST_MAIN_PRIORITY 1  // as app_main()
+
+// a test still running after this long is stuck: the tasks are listed and it fails
+#ifndef HOST_WATCHDOG_TICKS
+#define HOST_WATCHDOG_TICKS 60000
+#endif
+
+enum host_task_state_e {
+    HOST_TASK_FREE = 0,
+    HOST_TASK_RUNNING,
+    HOST_TASK_READY,
+    HOST_TASK_BLOCKED,
+    HOST_TASK_DELETED,
+};
+
+struct host_task_s {
+    enum host_task_state_e state;
+    pthread_t thread;
+    pthread_cond_t cond;
+    TaskFunction_t funct;
+    void* arg;
+    const char* name;
+    UBaseType_t priority;
+    int core;                   // requested at creation
+    uint32_t seq;               // order in which the tasks became ready
+    const void* waiting;        // object the task is blocked on, NULL for a delay
+    bool timed;
+    bool timed_out;
+    TickType_t wake;
+    uint32_t notify;
+    int critical;
+    void* stack;                // allocated from the heap for a dynamic task, as on the target
+};
+
+static struct host_task_s host_tasks[HOST_MAX_TASKS];
+static struct host_task_s* host_current = NULL;  // holding the core, NULL while idle
+static __thread struct host_task_s* host_self = NULL;
+static pthread_mutex_t host_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t host_once = PTHREAD_ONCE_INIT;
+static TickType_t host_ticks = 0;
+static uint32_t host_seq = 0;
+static uint32_t host_idle = 0;
+static bool host_slice = false;  // set at each tick, to share the core among equal priorities
+
+
+/* Scheduler, called with the lock held */
+static void host_ready(struct host_task_s* task) {
+    task->state = HOST_TASK_READY;
+    task->waiting = NULL;
+    task->seq = ++host_seq;
+}
+
+static struct host_task_s* host_pick(void) {
+    struct host_task_s* best = NULL;
+    for (int i=0 ; i<HOST_MAX_TASKS ; i++) {
+        struct host_task_s* task = &host_tasks[i];
+        if ( task->state != HOST_TASK_READY ) {
+            continue;
+        }
+        if ( best == NULL  ||  task->priority > best->priority  ||  (task->priority == best->priority  &&  task->seq < best->seq) ) {
+            best = task;
+        }
+    }
+    return best;
+}
+
+static void host_dispatch(void) {
+    host_slice = false;
+    host_current = host_pick();
+    if ( host_current != NULL ) {
+        host_current->state = HOST_TASK_RUNNING;
+        pthread_cond_signal(&host_current->cond);
+    }
+}
+
+/* Gives the core to the best ready task, and waits to get it back */
+static void host_schedule(struct host_task_s* self) {
+    host_dispatch();
+    while ( host_current != self ) {
+        pthread_cond_wait(&self->cond, &host_lock);
+    }
+}
+
+static void host_preempt(struct host_task_s* self) {
+    if ( self->critical > 0 ) {
+        return;
+    }
+    struct host_task_s* best = host_pick();
+    if ( best != NULL  &&  (best->priority > self->priority  ||  (host_slice  &&  best->priority == self->priority)) ) {
+        host_ready(self);
+        host_schedule(self);
+    }
+}
+
+/* Returns false if the timeout expired before the task was woken */
+static bool host_block(struct host_task_s* self, const void* object, TickType_t ticks) {
+    self->state = HOST_TASK_BLOCKED;
+    self->waiting = object;
+    self->timed = ticks != portMAX_DELAY;
+    self->timed_out = false;
+    self->wake = host_ticks + ticks;
+    host_schedule(self);
+    return !self->timed_out;
+}
+
+static void host_wake_waiter(const void* object) {
+    struct host_task_s* best = NULL;
+    for (int i=0 ; i<HOST_MAX_TASKS ; i++) {
+        struct host_task_s* task = &host_tasks[i];
+        if ( task->state == HOST_TASK_BLOCKED  &&  task->waiting == object  &&  object != NULL ) {
+            if ( best == NULL  ||  task->priority > best->priority ) {
+                best = task;
+            }
+        }
+    }
+    if ( best != NULL ) {
+        host_ready(best);
+    }
+}
+
+static void host_watchdog(void) {
+    static const char* states[] = { "free", "running", "ready", "blocked", "deleted" };
+    fprintf(stderr, "freertos_host: stuck after %u ticks, current task: %s\n", host_ticks, host_current != NULL ? host_current->name : "idle");
+    for (int i=0 ; i<HOST_MAX_TASKS ; i++) {
+        struct host_task_s* task = &host_tasks[i];
+        if ( task->state != HOST_TASK_FREE ) {
+            fprintf(stderr, "  %-16s %-8s priority %2u  waiting %p  wake %u  notify %u  critical %d\n", task->name, states[task->state],
+                    task->priority, task->waiting, task->timed ? task->wake : 0, task->notify, task->critical);
+        }
+    }
+    abort();
+}
+
+static void* host_tick(void* arg) {
+    struct timespec period = { .tv_sec = 0, .tv_nsec = 1000000 };
+    while (1) {
+        nanosleep(&period, NULL);
+        pthread_mutex_lock(&host_lock);
+        host_ticks++;
+        if ( host_ticks == HOST_WATCHDOG_TICKS ) {
+            host_watchdog();
+        }
+        if ( host_current == NULL ) {
+            host_idle++;
+        }
+        for (int i=0 ; i<HOST_MAX_TASKS ; i++) {
+            struct host_task_s* task = &host_tasks[i];
+            if ( task->state == HOST_TASK_BLOCKED  &&  task->timed  &&  (int32_t)(host_ticks - task->wake) >= 0 ) {
+                host_ready(task);
+                task->timed_out = true;
+            }
+        }
+        if ( host_current == NULL ) {
+            host_dispatch();
+        }
+        else {
+            host_slice = true;
+        }
+        pthread_mutex_unlock(&host_lock);
+    }
+    return NULL;
+}
+
+static void host_start(void) {
+    pthread_t thread;
+    pthread_create(&thread, NULL, host_tick, NULL);
+    pthread_detach(thread);
+}
+
+static struct host_task_s* host_alloc(void) {
+    for (int i=0 ; i<HOST_MAX_TASKS ; i++) {
+        if ( host_tasks[i].state == HOST_TASK_FREE ) {
+            struct host_task_s* task = &host_tasks[i];
+            memset(task, 0, sizeof(struct host_task_s));
+            pthread_cond_init(&task->cond, NULL);
+            return task;
+        }
+    }
+    fprintf(stderr, "freertos_host: more than %d tasks\n", HOST_MAX_TASKS);
+    abort();
+}
+
+/* Every FreeRTOS call is a scheduling point. The first thread calling FreeRTOS (the
+   main thread of the test) becomes a task. */
+static struct host_task_s* host_enter(void) {
+    pthread_once(&host_once, host_start);
+    pthread_mutex_lock(&host_lock);
+    if ( host_self == NULL ) {
+        host_self = host_alloc();
+        host_self->thread = pthread_self();
+        host_self->name = "main";
+        host_self->priority = HOST_MAIN_PRIORITY;
+        host_ready(host_self);
+        if ( host_current == NULL ) {
+            host_schedule(host_self);
+        }
+        else {
+            while ( host_current != host_self ) {
+                pthread_cond_wait(&host_self->cond, &host_lock);
+            }
+        }
+    }
+    host_preempt(host_self);
+    return host_self;
+}
+
+static void host_leave(void) {
+    pthread_mutex_unlock(&host_lock);
+}
+
+
+/* Tasks */
+static void* host_task_main(void* arg) {
+    struct host_task_s* task = arg;
+    host_self = task;
+    pthread_mutex_lock(&host_lock);
+    while ( host_current != task ) {
+        pthread_cond_wait(&task->cond, &host_lock);
+    }
+    pthread_mutex_unlock(&host_lock);
+
+    task->funct(task->arg);
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+static TaskHandle_t host_task_create(TaskFunction_t funct, const char* name, void* arg, UBaseType_t priority, int core, void* stack) {
+    struct host_task_s* self = host_enter();
+    struct host_task_s* task = host_alloc();
+    task->funct = funct;
+    task->arg = arg;
+    task->name = name;
+    task->priority = priority;
+    task->core = core;
+    task->stack = stack;
+    host_ready(task);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    pthread_create(&task->thread, &attr, host_task_main, task);
+    pthread_attr_destroy(&attr);
+
+    host_preempt(self);
+    host_leave();
+    return task;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core) {
+    void* stack = malloc(stack_size);
+    if ( stack == NULL ) {
+        return pdFAIL;
+    }
+    TaskHandle_t task = host_task_create(funct, name, arg, priority, core, stack);
+    if ( handle != NULL ) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(funct, name, stack_size, arg, priority, handle, tskNO_AFFINITY);
+}
+
+TaskHandle_t xTaskCreateStaticPinnedToCore(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buff, BaseType_t core) {
+    return host_task_create(funct, name, arg, priority, core, NULL);
+}
+
+TaskHandle_t xTaskCreateStatic(TaskFunction_t funct, const char* name, uint32_t stack_size, void* arg, UBaseType_t priority, StackType_t* stack, StaticTask_t* task_buff) {
+    return host_task_create(funct, name, arg, priority, tskNO_AFFINITY, NULL);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+    struct host_task_s* self = host_enter();
+    if ( task == NULL  ||  task == self ) {
+        free(self->stack);
+        self->state = HOST_TASK_FREE;  // the thread does not touch its slot anymore
+        host_dispatch();
+        host_leave();
+        pthread_exit(NULL);
+    }
+    free(task->stack);
+    task->stack = NULL;
+    task->state = HOST_TASK_DELETED;  // its thread stays blocked for good
+    host_leave();
+}
+
+eTaskState eTaskGetState(TaskHandle_t task) {
+    static const eTaskState states[] = { eInvalid, eRunning, eReady, eBlocked, eDeleted };
+    host_enter();
+    eTaskState state = states[task->state];
+    host_leave();
+    return state;
+}
+
+void vTaskDelay(TickType_t ticks) {
+    struct host_task_s* self = host_enter();
+    if ( ticks == 0 ) {
+        host_ready(self);
+        host_schedule(self);
+    }
+    else {
+        host_block(self, NULL, ticks);
+    }
+    host_leave();
+}
+
+void vPortYield(void) {
+    vTaskDelay(0);
+}
+
+TickType_t xTaskGetTickCount(void) {
+    host_enter();
+    TickType_t ticks = host_ticks;
+    host_leave();
+    return ticks;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void) {
+    struct host_task_s* self = host_enter();
+    host_leave();
+    return self;
+}
+
+void vTaskPrioritySet(TaskHandle_t task, UBaseType_t priority) {
+    struct host_task_s* self = host_enter();
+    (task != NULL ? task : self)->priority = priority;
+    host_preempt(self);
+    host_leave();
+}
+
+UBaseType_t uxTaskPriorityGet(TaskHandle_t task) {
+    struct host_task_s* self = host_enter();
+    UBaseType_t priority = (task != NULL ? task : self)->priority;
+    host_leave();
+    return priority;
+}
+
+BaseType_t xPortGetCoreID(void) {
+    return 0;
+}
+
+
+/* Notifications */
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+    struct host_task_s* self = host_enter();
+    task->notify++;
+    if ( task->state == HOST_TASK_BLOCKED  &&  task->waiting == &task->notify ) {
+        host_ready(task);
+    }
+    host_preempt(self);
+    host_leave();
+    return pdPASS;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear, TickType_t ticks) {
+    struct host_task_s* self = host_enter();
+    if ( self->notify == 0  &&  ticks > 0 ) {
+        host_block(self, &self->notify, ticks);
+    }
+    uint32_t value = self->notify;
+    if ( value > 0 ) {
+        self->notify = clear ? 0 : value-1;
+    }
+    host_leave();
+    return value;
+}
+
+
+/* Semaphores */
+static SemaphoreHandle_t host_semaphore_init(StaticSemaphore_t* sem, UBaseType_t count, bool dynamic) {
+    if ( sem != NULL ) {
+        sem->count = count;
+        sem->max = 1;
+        sem->dynamic = dynamic;
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void) {
+    return host_semaphore_init(malloc(sizeof(StaticSemaphore_t)), 0, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinaryStatic(StaticSemaphore_t* buff) {
+    return host_semaphore_init(buff, 0, false);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex(void) {
+    return host_semaphore_init(malloc(sizeof(StaticSemaphore_t)), 1, true);
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t* buff) {
+    return host_semaphore_init(buff, 1, false);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+    if ( sem->dynamic ) {
+        free(sem);
+    }
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+    struct host_task_s* self = host_enter();
+    TickType_t start = host_ticks;
+    while ( sem->count == 0 ) {
+        TickType_t elapsed = host_ticks - start;
+        if ( ticks != portMAX_DELAY  &&  elapsed >= ticks ) {
+            host_leave();
+            return pdFALSE;
+        }
+        host_block(self, sem, ticks == portMAX_DELAY ? portMAX_DELAY : ticks-elapsed);
+    }
+    sem->count--;
+    host_leave();
+    return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+    struct host_task_s* self = host_enter();
+    if ( sem->count >= sem->max ) {
+        host_leave();
+        return pdFALSE;
+    }
+    sem->count++;
+    host_wake_waiter(sem);
+    host_preempt(self);
+    host_leave();
+    return pdTRUE;
+}
+
+
+/* Critical sections: with a single core, they only hold off the preemption */
+void vPortEnterCritical(portMUX_TYPE* mux) {
+    struct host_task_s* self = host_enter();
+    self->critical++;
+    host_leave();
+}
+
+void vPortExitCritical(portMUX_TYPE* mux) {
+    pthread_mutex_lock(&host_lock);
+    struct host_task_s* self = host_self;
+    if ( --self->critical == 0 ) {
+        host_preempt(self);
+    }
+    pthread_mutex_unlock(&host_lock);
+}
+
+
+/* Test helpers */
+int host_task_core(TaskHandle_t task) {
+    host_enter();
+    int core = task->core;
+    host_leave();
+    return core;
+}
+
+uint32_t host_idle_ticks(void) {
+    host_enter();
+    uint32_t ticks = host_idle;
+    host_leave();
+    return ticks;
+}
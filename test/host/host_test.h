@@ -0,0 +1,38 @@
+#ifndef HOST_TEST_H__
+#define HOST_TEST_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "freertos/FreeRTOS.h"
+
+
+#define TEST_ASSERT(cond)  \
+            do {  \
+                if ( !(cond) ) {  \
+                    printf("%s:%d: assertion failed: %s\n", __FILE__, __LINE__, #cond);  \
+                    exit(1);  \
+                }  \
+            } while (0)
+
+#define TEST_PASS() printf("%s: passed\n", __FILE__)
+
+
+/* Simulation of the target, see freertos_host.c */
+int host_task_core(TaskHandle_t task);
+uint32_t host_idle_ticks(void);
+
+/* Console input, read by getchar() */
+void host_input(const char* bytes);
+
+/* Heap calls made while the trap is armed are counted and reported */
+void host_heap_trap(bool armed);
+uint32_t host_heap_calls(void);
+
+/* Log lines written with ESP_LOGx */
+uint32_t host_log_count(void);
+
+
+#endif //HOST_TEST_H__
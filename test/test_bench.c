@@ -0,0 +1,68 @@
+/* The benchmarks, and the bench command, run on the host: the counter counts
+   nanoseconds, and the benchmarks needing PSRAM are skipped. The dispatch benchmarks
+   are skipped too when commands cannot be registered at runtime. */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "cli.h"
+#include "cmd_run.h"
+#include "cmd_create.h"
+#include "cli_bench.h"
+
+
+#if defined(CONFIG_CLI_DYNAMIC_COMMANDS_MAX) && CONFIG_CLI_DYNAMIC_COMMANDS_MAX>0
+#define DISPATCH_EXPECTED ESP_OK
+#else
+#define DISPATCH_EXPECTED ESP_ERR_NOT_SUPPORTED
+#endif
+
+struct bench_find_s {
+    const char* name;
+    const cli_bench_info_t* info;
+};
+
+static bool bench_find_cb(const cli_bench_info_t* info, void* arg) {
+    struct bench_find_s* find = arg;
+    if ( strcmp(info->name, find->name) == 0 ) {
+        find->info = info;
+        return false;
+    }
+    return true;
+}
+
+static esp_err_t bench_run(const char* name) {
+    struct bench_find_s find = { .name = name, .info = NULL };
+    cli_bench_foreach(bench_find_cb, &find);
+    TEST_ASSERT(find.info != NULL);
+
+    cli_bench_opts_t opts = { .samples = 5, .warmup = 1, .sample_us = 200, .cancelled = NULL };
+    cli_bench_result_t result;
+    esp_err_t err = cli_bench_run(find.info, &opts, &result);
+    if ( err == ESP_OK ) {
+        TEST_ASSERT(result.iterations > 0);
+        TEST_ASSERT(result.samples == opts.samples);
+        TEST_ASSERT(result.min <= result.median  &&  result.median <= result.p99);
+    }
+    return err;
+}
+
+
+int main(void) {
+    cli_init_t init = CLI_INIT_DEFAULT();
+    esp_cli_init(init);
+
+    TEST_ASSERT(bench_run("memcpy_dram") == ESP_OK);
+    TEST_ASSERT(bench_run("memset_dram") == ESP_OK);
+    TEST_ASSERT(bench_run("malloc_free_256") == ESP_OK);
+    TEST_ASSERT(bench_run("memcpy_psram") == ESP_ERR_NOT_SUPPORTED);
+    TEST_ASSERT(bench_run("dispatch_call") == DISPATCH_EXPECTED);
+    TEST_ASSERT(bench_run("dispatch_task") == DISPATCH_EXPECTED);
+
+    TEST_ASSERT(CLI_RUN("bench") == CLI_CMD_RETURN_OK);
+    TEST_ASSERT(CLI_RUN("bench memset dispatch -n 5 -t 200") == CLI_CMD_RETURN_OK);
+    TEST_ASSERT(CLI_RUN("bench nothing") == CLI_CMD_RETURN_ARG_ERROR);
+    TEST_ASSERT(CLI_RUN("bench all -n 0") == CLI_CMD_RETURN_ARG_ERROR);
+    TEST_PASS();
+    return 0;
+}
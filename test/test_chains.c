@@ -0,0 +1,46 @@
+/* A trailing ';' ends a chain, while a chain ending with '&&' or '||' is rejected, and
+   is not taken for a command run in the background. */
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "cli.h"
+#include "cmd_run.h"
+#include "cmd_create.h"
+
+
+static volatile int hello_runs = 0;
+
+CLI_CMD(hello) {
+    hello_runs++;
+    return CLI_CMD_RETURN_OK;
+}
+
+
+int main(void) {
+    cli_init_t init = CLI_INIT_DEFAULT();
+    esp_cli_init(init);
+
+    TEST_ASSERT(CLI_RUN("hello ;") == CLI_CMD_RETURN_OK);
+    TEST_ASSERT(hello_runs == 1);
+
+    TEST_ASSERT(CLI_RUN("hello &&") == CLI_CMD_RETURN_RUNTIME_ERROR);
+    TEST_ASSERT(CLI_RUN("hello ||  ") == CLI_CMD_RETURN_RUNTIME_ERROR);
+    TEST_ASSERT(CLI_RUN_ASYNC("hello &&") == CLI_CMD_RETURN_RUNTIME_ERROR);
+    TEST_ASSERT(CLI_RUN_ASYNC("hello && &") == CLI_CMD_RETURN_RUNTIME_ERROR);
+    vTaskDelay(10);
+    TEST_ASSERT(hello_runs == 1);
+
+    TEST_ASSERT(CLI_RUN_ASYNC("hello &") == CLI_CMD_RETURN_OK);
+    vTaskDelay(10);
+    TEST_ASSERT(hello_runs == 2);
+
+    // typed: the line ending with '&&' runs in the foreground, and fails
+    host_input("hello && hello&&\n");
+    vTaskDelay(100);
+    TEST_ASSERT(hello_runs == 2);
+    host_input("hello&\n");
+    vTaskDelay(100);
+    TEST_ASSERT(hello_runs == 3);
+    TEST_PASS();
+    return 0;
+}
@@ -0,0 +1,66 @@
+/* A cooperative command yielding or waiting blocks the task running it until its next
+   step, so the tasks of lower priority keep running meanwhile. The notifications of the
+   caller's task are left to it. */
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "cli.h"
+#include "cmd_run.h"
+#include "cmd_create.h"
+
+
+#define YIELDS 20
+
+struct yielder_s {
+    int i;
+};
+
+CLI_CMD_COOP(yielder, struct yielder_s) {
+    struct yielder_s* s = CLI_COOP_STATE(struct yielder_s);
+    CLI_COOP_BEGIN();
+    for (s->i=0 ; s->i<YIELDS ; s->i++) {
+        CLI_COOP_YIELD();
+    }
+    CLI_COOP_END();
+}
+
+static volatile uint32_t low_runs = 0;
+
+CLI_CMD_COOP(waiter, struct yielder_s) {
+    CLI_COOP_BEGIN();
+    CLI_COOP_WAIT_UNTIL(low_runs >= 1000);
+    CLI_COOP_END();
+}
+
+static volatile bool high_done = false;
+
+static void high_task(void* arg) {
+    uint32_t before = low_runs;
+    TickType_t start = xTaskGetTickCount();
+    xTaskNotifyGive(xTaskGetCurrentTaskHandle());
+    TEST_ASSERT(CLI_CALL("yielder", NULL, 0) == CLI_CMD_RETURN_OK);
+    TEST_ASSERT(xTaskGetTickCount() - start >= YIELDS);
+    TEST_ASSERT(low_runs - before > 0);
+    TEST_ASSERT(ulTaskNotifyTake(pdTRUE, 0) == 1);  // still pending
+
+    // only returns once the task of lower priority ran long enough
+    TEST_ASSERT(CLI_CALL("waiter", NULL, 0) == CLI_CMD_RETURN_OK);
+    TEST_ASSERT(low_runs >= 1000);
+    high_done = true;
+    vTaskDelete(NULL);
+}
+
+
+int main(void) {
+    cli_init_t init = CLI_INIT_DEFAULT();
+    esp_cli_init(init);
+
+    // this task, of the lowest priority, only runs when the command task blocks
+    xTaskCreate(high_task, "high", 4096, NULL, 10, NULL);
+    while ( !high_done ) {
+        low_runs++;
+        xTaskGetTickCount();  // a scheduling point
+    }
+    TEST_PASS();
+    return 0;
+}
@@ -0,0 +1,66 @@
+/* The placement of the commands, with simulated cores: core 0 is idle when no task runs
+   in the simulation, and the idle time of core 1 is set by the test. */
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "cmd_placement.h"
+#include "cmd_create.h"
+
+
+static int fake_cores = 2;
+static uint32_t fake_idle = 0;
+
+static int fake_core_count(void) {
+    return fake_cores;
+}
+
+static bool fake_idle_time(int core, uint32_t* time) {
+    *time = core == 0 ? host_idle_ticks() : fake_idle;
+    return true;
+}
+
+static const cli_placement_ops_t fake_ops = {
+    .core_count = fake_core_count,
+    .idle_time = fake_idle_time,
+};
+
+static void busy_ticks(TickType_t ticks) {
+    TickType_t start = xTaskGetTickCount();
+    while ( xTaskGetTickCount() - start < ticks ) {
+    }
+}
+
+
+int main(void) {
+    cli_placement_t placement = { 0 };
+
+    // the core whose idle time grew the most since the previous selection
+    cli_placement_select(CLI_CMD_CORE_IDLE, &fake_ops, &placement);
+    vTaskDelay(20);
+    fake_idle += 5;
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_IDLE, &fake_ops, &placement) == 0);
+    busy_ticks(20);
+    fake_idle += 5;
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_IDLE, &fake_ops, &placement) == 1);
+    vTaskDelay(20);
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_IDLE, &fake_ops, &placement) == 0);
+
+    // without the idle times, any core
+    const cli_placement_ops_t no_idle_ops = { .core_count = fake_core_count, .idle_time = NULL };
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_IDLE, &no_idle_ops, &placement) == tskNO_AFFINITY);
+
+    // a core the chip does not have
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_PINNED(1), &fake_ops, &placement) == 1);
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_PINNED(2), &fake_ops, &placement) == tskNO_AFFINITY);
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_ANY, &fake_ops, &placement) == tskNO_AFFINITY);
+
+    // the default policy keeps the commands off the protocol core
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_DEFAULT, &fake_ops, &placement) == 1-CONFIG_CLI_CMD_PROTOCOL_CORE);
+    TEST_ASSERT(cli_placement_core(CLI_CMD_CORE_DEFAULT) == 1-CONFIG_CLI_CMD_PROTOCOL_CORE);
+
+    fake_cores = 1;
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_PINNED(1), &fake_ops, &placement) == tskNO_AFFINITY);
+    TEST_ASSERT(cli_placement_select(CLI_CMD_CORE_IDLE, &fake_ops, &placement) == tskNO_AFFINITY);
+    TEST_PASS();
+    return 0;
+}
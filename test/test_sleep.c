@@ -0,0 +1,42 @@
+/* A command sleeping periodically keeps the phase of its schedule: after an overrun, the
+   missed periods are skipped instead of restarting the schedule from the overrun. */
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "cli.h"
+#include "cmd_run.h"
+#include "cmd_create.h"
+
+
+#define PERIOD_MS 10
+
+static void busy_ticks(TickType_t ticks) {
+    TickType_t start = xTaskGetTickCount();
+    while ( xTaskGetTickCount() - start < ticks ) {
+    }
+}
+
+CLI_CMD(periodic) {
+    TickType_t start = xTaskGetTickCount();
+    TickType_t last_wake = start;
+    TEST_ASSERT(CLI_CMD_MSSLEEP_UNTIL(&last_wake, PERIOD_MS));
+    TEST_ASSERT(last_wake == start + PERIOD_MS);
+    TEST_ASSERT((int32_t)(xTaskGetTickCount() - last_wake) >= 0);
+
+    busy_ticks(pdMS_TO_TICKS(PERIOD_MS*2 + PERIOD_MS/2));  // overruns two periods
+    TEST_ASSERT(CLI_CMD_MSSLEEP_UNTIL(&last_wake, PERIOD_MS));
+    TEST_ASSERT((last_wake - start) % PERIOD_MS == 0);
+    TEST_ASSERT(last_wake - start >= 4*PERIOD_MS);
+    TEST_ASSERT((int32_t)(xTaskGetTickCount() - last_wake) >= 0);
+    return CLI_CMD_RETURN_OK;
+}
+
+
+int main(void) {
+    cli_init_t init = CLI_INIT_DEFAULT();
+    esp_cli_init(init);
+
+    TEST_ASSERT(CLI_RUN("periodic") == CLI_CMD_RETURN_OK);
+    TEST_PASS();
+    return 0;
+}
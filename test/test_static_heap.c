@@ -0,0 +1,89 @@
+/* With static allocation, running commands never touches the heap: not for a command
+   run on a command task, a chain of commands, a command called with its output captured,
+   run in the background or cancelled, nor for a line typed with autocompletion. Every
+   heap call made after the start is trapped. */
+
+#include <string.h>
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "cli.h"
+#include "cmd_run.h"
+#include "cmd_create.h"
+
+
+static volatile int hello_runs = 0;
+
+CLI_CMD(hello) {
+    hello_runs++;
+    cli_printf("hello %s\n", argc > 1 ? argv[1] : "world");
+    return CLI_CMD_RETURN_OK;
+}
+
+CLI_CMD(fail) {
+    return CLI_CMD_RETURN_ERROR;
+}
+
+static volatile int stall_cancels = 0;
+
+CLI_CMD_DECLARE(stall, 2048, 10, .timeout_ms = 20) {
+    while ( !CLI_CMD_CANCELLED() ) {
+        vTaskDelay(1);
+    }
+    stall_cancels++;
+    return CLI_CMD_RETURN_CANCELLED;
+}
+
+CLI_CMD_IN_CALLER(echo) {
+    for (int i=1 ; i<argc ; i++) {
+        cli_printf("%s%s", argv[i], i < argc-1 ? " " : "");
+    }
+    return CLI_CMD_RETURN_OK;
+}
+
+
+int main(void) {
+    host_heap_trap(true);
+
+    cli_init_t init = CLI_INIT_DEFAULT();
+    esp_cli_init(init);
+
+    // several times, so the pooled contexts and tasks are reused
+    for (int i=0 ; i<4 ; i++) {
+        hello_runs = 0;
+        TEST_ASSERT(CLI_RUN("hello") == CLI_CMD_RETURN_OK);
+        TEST_ASSERT(hello_runs == 1);
+
+        TEST_ASSERT(CLI_RUN("fail && hello skipped ; hello chain || hello skipped") == CLI_CMD_RETURN_OK);
+        TEST_ASSERT(hello_runs == 2);
+
+        char out[32];
+        TEST_ASSERT(CLI_CALL("echo captured \"output\"", out, sizeof(out)) == CLI_CMD_RETURN_OK);
+        TEST_ASSERT(strcmp(out, "captured output") == 0);
+
+        TEST_ASSERT(CLI_RUN_ASYNC("hello background") == CLI_CMD_RETURN_OK);
+        while ( hello_runs < 3 ) {
+            vTaskDelay(1);
+        }
+
+        // cancelled by the deadline of the caller
+        TEST_ASSERT(CLI_RUN("stall") == CLI_CMD_RETURN_TIMEOUT);
+        while ( stall_cancels < i+1 ) {
+            vTaskDelay(1);
+        }
+
+        // typed with autocompletion: "he" is completed to "hello "
+        host_input("he\t");
+        vTaskDelay(10);
+        host_input("lo\n");
+        while ( hello_runs < 4 ) {
+            vTaskDelay(1);
+        }
+        vTaskDelay(10);  // back to the prompt
+    }
+
+    host_heap_trap(false);
+    TEST_ASSERT(host_heap_calls() == 0);
+    TEST_PASS();
+    return 0;
+}
@@ -0,0 +1,63 @@
+/* With static allocation, the command tasks are created on first use. Once they were all
+   created on core 0, a command pinned to core 1 runs on a free task created again on
+   core 1, and the next commands pinned to core 0 still run on core 0. */
+
+#include "host_test.h"
+#include "freertos/task.h"
+#include "cli.h"
+#include "cmd_run.h"
+#include "cmd_create.h"
+
+
+static volatile bool release = false;
+static volatile int holders = 0;
+
+CLI_CMD_DECLARE(hold, 2048, 10, .timeout_ms = CLI_CMD_TIMEOUT_NONE, .core = CLI_CMD_CORE_PINNED(0)) {
+    holders++;
+    while ( !release ) {
+        vTaskDelay(1);
+    }
+    holders--;
+    return CLI_CMD_RETURN_OK;
+}
+
+static volatile int on_core = -1;
+
+CLI_CMD_DECLARE(pinned, 2048, 10, .core = CLI_CMD_CORE_PINNED(1)) {
+    on_core = host_task_core(xTaskGetCurrentTaskHandle());
+    return CLI_CMD_RETURN_OK;
+}
+
+CLI_CMD_DECLARE(pinned0, 2048, 10, .core = CLI_CMD_CORE_PINNED(0)) {
+    on_core = host_task_core(xTaskGetCurrentTaskHandle());
+    return CLI_CMD_RETURN_OK;
+}
+
+
+int main(void) {
+    cli_init_t init = CLI_INIT_DEFAULT();
+    esp_cli_init(init);
+
+    // all the command tasks are created on core 0
+    for (int i=0 ; i<CONFIG_CLI_STATIC_CMD_TASKS ; i++) {
+        TEST_ASSERT(CLI_RUN_ASYNC("hold") == CLI_CMD_RETURN_OK);
+    }
+    TEST_ASSERT(holders == CONFIG_CLI_STATIC_CMD_TASKS);
+    TEST_ASSERT(CLI_RUN("pinned") == CLI_CMD_RETURN_RUNTIME_ERROR);  // none is free
+    release = true;
+    while ( holders > 0 ) {
+        vTaskDelay(1);
+    }
+    vTaskDelay(10);  // the tasks are free once the commands released their context
+
+    uint32_t logs = host_log_count();
+    for (int i=0 ; i<3 ; i++) {
+        TEST_ASSERT(CLI_RUN("pinned") == CLI_CMD_RETURN_OK);
+        TEST_ASSERT(on_core == 1);
+        TEST_ASSERT(CLI_RUN("pinned0") == CLI_CMD_RETURN_OK);
+        TEST_ASSERT(on_core == 0);
+    }
+    TEST_ASSERT(host_log_count() == logs);  // nothing to warn about
+    TEST_PASS();
+    return 0;
+}